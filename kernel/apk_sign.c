@@ -1,9 +1,17 @@
 #include <linux/err.h>
 #include <linux/fs.h>
 #include <linux/gfp.h>
+#include <linux/jhash.h>
 #include <linux/kernel.h>
+#include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/version.h>
+#include <linux/vmalloc.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+#include <linux/unaligned.h>
+#else
+#include <asm/unaligned.h>
+#endif
 #ifdef CONFIG_KSU_DEBUG
 #include <linux/moduleparam.h>
 #endif
@@ -18,11 +26,6 @@
 #include "klog.h" // IWYU pragma: keep
 #include "manager_sign.h"
 
-struct sdesc {
-    struct shash_desc shash;
-    char ctx[];
-};
-
 static apk_sign_key_t apk_sign_keys[] = {
     { EXPECTED_SIZE_SHIRKNEKO, EXPECTED_HASH_SHIRKNEKO }, // ShirkNeko/SukiSU 
 #ifdef EXPECTED_SIZE
@@ -30,244 +33,394 @@ static apk_sign_key_t apk_sign_keys[] = {
 #endif
 };
 
-static struct sdesc *init_sdesc(struct crypto_shash *alg)
+// Set up on first use: the sha256 transform, which may live in a module
+// that isn't loaded yet when we init, and the binary form of the key hashes
+static DEFINE_MUTEX(apk_sign_lock);
+static struct crypto_shash *sha256_tfm;
+static u8 apk_sign_digests[ARRAY_SIZE(apk_sign_keys)][SHA256_DIGEST_SIZE];
+
+static struct crypto_shash *ksu_sha256_tfm(void)
 {
-    struct sdesc *sdesc;
-    int size;
+    struct crypto_shash *tfm;
+    int i;
 
-    size = sizeof(struct shash_desc) + crypto_shash_descsize(alg);
-    sdesc = kzalloc(size, GFP_KERNEL);
-    if (!sdesc)
-        return ERR_PTR(-ENOMEM);
-    sdesc->shash.tfm = alg;
-    return sdesc;
-}
+    // pairs with smp_store_release below
+    tfm = smp_load_acquire(&sha256_tfm);
+    if (likely(tfm))
+        return tfm;
 
-static int calc_hash(struct crypto_shash *alg, const unsigned char *data,
-             unsigned int datalen, unsigned char *digest)
-{
-    struct sdesc *sdesc;
-    int ret;
+    mutex_lock(&apk_sign_lock);
+    tfm = sha256_tfm;
+    if (tfm)
+        goto out;
 
-    sdesc = init_sdesc(alg);
-    if (IS_ERR(sdesc)) {
-        pr_info("can't alloc sdesc\n");
-        return PTR_ERR(sdesc);
+    for (i = 0; i < ARRAY_SIZE(apk_sign_keys); i++) {
+        if (strlen(apk_sign_keys[i].sha256) != SHA256_DIGEST_SIZE * 2 ||
+            hex2bin(apk_sign_digests[i], apk_sign_keys[i].sha256,
+                    SHA256_DIGEST_SIZE)) {
+            pr_err("invalid manager hash: %s\n", apk_sign_keys[i].sha256);
+            // can't match any digest, but a zero size matches no cert
+            apk_sign_keys[i].size = 0;
+        }
     }
 
-    ret = crypto_shash_digest(&sdesc->shash, data, datalen, digest);
-    kfree(sdesc);
-    return ret;
+    tfm = crypto_alloc_shash("sha256", 0, 0);
+    if (IS_ERR(tfm)) {
+        pr_info("can't alloc alg sha256\n");
+        tfm = NULL;
+        goto out;
+    }
+    smp_store_release(&sha256_tfm, tfm);
+out:
+    mutex_unlock(&apk_sign_lock);
+    return tfm;
 }
 
 static int ksu_sha256(const unsigned char *data, unsigned int datalen,
-              unsigned char *digest)
+                      unsigned char *digest)
 {
-    struct crypto_shash *alg;
-    char *hash_alg_name = "sha256";
+    struct crypto_shash *tfm = ksu_sha256_tfm();
     int ret;
 
-    alg = crypto_alloc_shash(hash_alg_name, 0, 0);
-    if (IS_ERR(alg)) {
-        pr_info("can't alloc alg %s\n", hash_alg_name);
-        return PTR_ERR(alg);
+    if (!tfm)
+        return -ENOENT;
+
+    {
+        SHASH_DESC_ON_STACK(desc, tfm);
+
+        desc->tfm = tfm;
+        ret = crypto_shash_digest(desc, data, datalen, digest);
+        shash_desc_zero(desc);
     }
-    ret = calc_hash(alg, data, datalen, digest);
-    crypto_free_shash(alg);
     return ret;
 }
 
-static bool check_block(struct file *fp, u32 *size4, loff_t *pos, u32 *offset)
+// A bounds-checked view into a buffer, all fields are little endian
+struct apk_cursor {
+    const u8 *p;
+    const u8 *end;
+};
+
+static bool cur_u32(struct apk_cursor *c, u32 *v)
 {
-    int i;
-    apk_sign_key_t sign_key;
+    if (c->end - c->p < 4)
+        return false;
+    *v = get_unaligned_le32(c->p);
+    c->p += 4;
+    return true;
+}
 
-    kernel_read(fp, size4, 0x4, pos); // signer-sequence length
-    kernel_read(fp, size4, 0x4, pos); // signer length
-    kernel_read(fp, size4, 0x4, pos); // signed data length
+static bool cur_u64(struct apk_cursor *c, u64 *v)
+{
+    if (c->end - c->p < 8)
+        return false;
+    *v = get_unaligned_le64(c->p);
+    c->p += 8;
+    return true;
+}
 
-    *offset += 0x4 * 3;
+// Carve a u32 length-prefixed region out of c into sub and step over it
+static bool cur_lp(struct apk_cursor *c, struct apk_cursor *sub)
+{
+    u32 len;
 
-    kernel_read(fp, size4, 0x4, pos); // digests-sequence length
+    if (!cur_u32(c, &len) || len > c->end - c->p)
+        return false;
+    sub->p = c->p;
+    sub->end = c->p + len;
+    c->p += len;
+    return true;
+}
 
-    *pos += *size4;
-    *offset += 0x4 + *size4;
+// Check the first certificate of the first signer of a v2 signature block.
+// Returns 1 if it is a manager key, 0 if not, or -errno if it couldn't be
+// hashed.
+static int check_block(const u8 *value, size_t len)
+{
+    struct apk_cursor block = { value, value + len };
+    struct apk_cursor signers, signer, signed_data, digests, certs, cert;
+    apk_sign_key_t sign_key;
+    u32 cert_len;
+    int i, ret;
+
+    if (!cur_lp(&block, &signers) || // signer-sequence
+        !cur_lp(&signers, &signer) || // signer
+        !cur_lp(&signer, &signed_data) || // signed data
+        !cur_lp(&signed_data, &digests) || // digests-sequence
+        !cur_lp(&signed_data, &certs) || // certificates
+        !cur_lp(&certs, &cert)) { // certificate
+        pr_info("malformed v2 signature block\n");
+        return 0;
+    }
+    cert_len = cert.end - cert.p;
 
-    kernel_read(fp, size4, 0x4, pos); // certificates length
-    kernel_read(fp, size4, 0x4, pos); // certificate length
-    *offset += 0x4 * 2;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    bool hashed = false;
 
     for (i = 0; i < ARRAY_SIZE(apk_sign_keys); i++) {
         sign_key = apk_sign_keys[i];
 
-        if (*size4 != sign_key.size)
+        if (cert_len != sign_key.size)
             continue;
-        *offset += *size4;
 
-#define CERT_MAX_LENGTH 1024
-        char cert[CERT_MAX_LENGTH];
-        if (*size4 > CERT_MAX_LENGTH) {
-            pr_info("cert length overlimit\n");
-            return false;
+        // keys of the same size share the digest
+        if (!hashed) {
+            ret = ksu_sha256(cert.p, cert_len, digest);
+            if (ret < 0) {
+                pr_info("sha256 error: %d\n", ret);
+                return ret;
+            }
+            hashed = true;
         }
-        kernel_read(fp, cert, *size4, pos);
-        unsigned char digest[SHA256_DIGEST_SIZE];
-        if (ksu_sha256(cert, *size4, digest) < 0) {
-            pr_info("sha256 error\n");
-            return false;
+
+        pr_info("sha256: %*phN, expected: %s\n", SHA256_DIGEST_SIZE, digest,
+                sign_key.sha256);
+        if (!memcmp(digest, apk_sign_digests[i], SHA256_DIGEST_SIZE)) {
+            return 1;
         }
+    }
+    return 0;
+}
 
-        char hash_str[SHA256_DIGEST_SIZE * 2 + 1];
-        hash_str[SHA256_DIGEST_SIZE * 2] = '\0';
+#define APK_EOCD_SIZE 22
+#define APK_EOCD_MAGIC 0x06054b50
+#define APK_MAX_COMMENT 0xffff
+#define APK_SIG_BLOCK_MAGIC "APK Sig Block 42"
+#define APK_SIG_FOOTER_SIZE 24 // block size + magic
+// real signing blocks are a few KB, refuse to allocate for garbage
+#define APK_SIG_BLOCK_MAX (16 << 20)
+
+#define APK_SIG_V2_ID 0x7109871au
+// http://aospxref.com/android-14.0.0_r2/xref/frameworks/base/core/java/android/util/apk/ApkSignatureSchemeV3Verifier.java#73
+#define APK_SIG_V3_ID 0xf05368c0u
+// http://aospxref.com/android-14.0.0_r2/xref/frameworks/base/core/java/android/util/apk/ApkSignatureSchemeV3Verifier.java#74
+#define APK_SIG_V3_1_ID 0x1b93ad61u
+
+// The end of the file, which holds the EOCD and often everything else
+struct apk_tail {
+    struct file *fp;
+    loff_t size; // file size
+    loff_t start; // file offset of buf
+    size_t len;
+    u8 *buf;
+};
 
-        bin2hex(hash_str, digest, SHA256_DIGEST_SIZE);
-        pr_info("sha256: %s, expected: %s\n", hash_str,
-            sign_key.sha256);
-        if (strcmp(sign_key.sha256, hash_str) == 0) {
-            return true;
-        }
+/*
+ * Return [off, off + len) of the file, from the tail buffer when it is
+ * there, otherwise read into a new buffer returned in *alloc for the caller
+ * to vfree. NULL means the range isn't in the file, an ERR_PTR that it
+ * couldn't be read this time.
+ */
+static const u8 *apk_read_range(struct apk_tail *tail, loff_t off, size_t len,
+                                u8 **alloc)
+{
+    loff_t pos = off;
+    u8 *buf;
+
+    *alloc = NULL;
+    if (off < 0 || len > tail->size || off > tail->size - len)
+        return NULL;
+
+    if (off >= tail->start && off + len <= tail->start + tail->len)
+        return tail->buf + (off - tail->start);
+
+    buf = vmalloc(len ? len : 1);
+    if (!buf)
+        return ERR_PTR(-ENOMEM);
+    if (kernel_read(tail->fp, buf, len, &pos) != len) {
+        vfree(buf);
+        return ERR_PTR(-EIO);
     }
-    return false;
+
+    *alloc = buf;
+    return buf;
 }
 
-struct zip_entry_header {
-    uint32_t signature;
-    uint16_t version;
-    uint16_t flags;
-    uint16_t compression;
-    uint16_t mod_time;
-    uint16_t mod_date;
-    uint32_t crc32;
-    uint32_t compressed_size;
-    uint32_t uncompressed_size;
-    uint16_t file_name_length;
-    uint16_t extra_field_length;
-} __attribute__((packed));
-
-// This is a necessary but not sufficient condition, but it is enough for us
-static bool has_v1_signature_file(struct file *fp)
+// https://en.wikipedia.org/wiki/Zip_(file_format)#End_of_central_directory_record_(EOCD)
+static const u8 *apk_find_eocd(struct apk_tail *tail)
 {
-    struct zip_entry_header header;
-    const char MANIFEST[] = "META-INF/MANIFEST.MF";
+    size_t i;
 
-    loff_t pos = 0;
+    for (i = 0; i <= APK_MAX_COMMENT && i + APK_EOCD_SIZE <= tail->len; i++) {
+        const u8 *eocd = tail->buf + tail->len - APK_EOCD_SIZE - i;
 
-    while (kernel_read(fp, &header,
-                      sizeof(struct zip_entry_header), &pos) ==
-           sizeof(struct zip_entry_header)) {
-        if (header.signature != 0x04034b50) {
-            // ZIP magic: 'PK'
-            return false;
-        }
-        // Read the entry file name
-        if (header.file_name_length == sizeof(MANIFEST) - 1) {
-            char fileName[sizeof(MANIFEST)];
-            kernel_read(fp, fileName,
-                           header.file_name_length, &pos);
-            fileName[header.file_name_length] = '\0';
-
-            // Check if the entry matches META-INF/MANIFEST.MF
-            if (strncmp(MANIFEST, fileName, sizeof(MANIFEST) - 1) ==
-                0) {
-                return true;
-            }
-        } else {
-            // Skip the entry file name
-            pos += header.file_name_length;
+        if (get_unaligned_le16(eocd + 20) == i &&
+            get_unaligned_le32(eocd) == APK_EOCD_MAGIC)
+            return eocd;
+    }
+    return NULL;
+}
+
+#define ZIP_CD_MAGIC 0x02014b50
+#define ZIP_CD_HEADER_SIZE 46
+#define APK_CD_MAX (16 << 20)
+
+/*
+ * Look for META-INF/MANIFEST.MF in the central directory. This is a
+ * necessary but not sufficient condition for a v1 signature, but it is
+ * enough for us. Unlike walking the local headers it doesn't depend on
+ * sizes being known up front, which they aren't with data descriptors.
+ */
+static int has_v1_signature_file(struct apk_tail *tail, const u8 *eocd)
+{
+    static const char MANIFEST[] = "META-INF/MANIFEST.MF";
+    u32 cd_size = get_unaligned_le32(eocd + 12);
+    u32 cd_offset = get_unaligned_le32(eocd + 16);
+    struct apk_cursor cd;
+    const u8 *buf;
+    u8 *alloc;
+    int found = 0;
+
+    if (cd_size > APK_CD_MAX)
+        return 0;
+
+    buf = apk_read_range(tail, cd_offset, cd_size, &alloc);
+    if (IS_ERR(buf))
+        return PTR_ERR(buf);
+    if (!buf)
+        return 0;
+
+    cd.p = buf;
+    cd.end = buf + cd_size;
+    while (cd.end - cd.p >= ZIP_CD_HEADER_SIZE) {
+        u16 name_len, extra_len, comment_len;
+        size_t entry_len;
+
+        if (get_unaligned_le32(cd.p) != ZIP_CD_MAGIC)
+            break;
+
+        name_len = get_unaligned_le16(cd.p + 28);
+        extra_len = get_unaligned_le16(cd.p + 30);
+        comment_len = get_unaligned_le16(cd.p + 32);
+        entry_len = ZIP_CD_HEADER_SIZE + name_len + extra_len + comment_len;
+        if (entry_len > cd.end - cd.p)
+            break;
+
+        if (name_len == sizeof(MANIFEST) - 1 &&
+            !memcmp(cd.p + ZIP_CD_HEADER_SIZE, MANIFEST, name_len)) {
+            found = 1;
+            break;
         }
 
-        // Skip to the next entry
-        pos += header.extra_field_length + header.compressed_size;
+        cd.p += entry_len;
     }
 
-    return false;
+    vfree(alloc);
+    return found;
 }
 
-static __always_inline bool check_v2_signature(char *path)
+/*
+ * Returns 1 for a manager APK and 0 for anything that parsed to a different
+ * verdict. Failures that may go away on a retry (open, allocation, short
+ * reads, no sha256 yet) return -errno, so callers don't remember them.
+ */
+static __always_inline int check_v2_signature(char *path)
 {
-    unsigned char buffer[0x11] = { 0 };
-    u32 size4;
-    u64 size8, size_of_block;
-
-    loff_t pos;
+    struct apk_tail tail = { 0 };
+    struct apk_cursor pairs;
+    const u8 *eocd, *footer, *block;
+    u8 *footer_alloc = NULL, *block_alloc = NULL;
+    u64 size_of_block;
+    u32 cd_offset;
+    int ret = 0;
 
     bool v2_signing_valid = false;
     int v2_signing_blocks = 0;
     bool v3_signing_exist = false;
     bool v3_1_signing_exist = false;
 
-    int i;
     struct file *fp = filp_open(path, O_RDONLY, 0);
     if (IS_ERR(fp)) {
         pr_err("open %s error.\n", path);
-        return false;
+        return PTR_ERR(fp);
     }
 
     // disable inotify for this file
     fp->f_mode |= FMODE_NONOTIFY;
 
-    // https://en.wikipedia.org/wiki/Zip_(file_format)#End_of_central_directory_record_(EOCD)
-    for (i = 0;; ++i) {
-        unsigned short n;
-        pos = generic_file_llseek(fp, -i - 2, SEEK_END);
-        kernel_read(fp, &n, 2, &pos);
-        if (n == i) {
-            pos -= 22;
-            kernel_read(fp, &size4, 4, &pos);
-            if ((size4 ^ 0xcafebabeu) == 0xccfbf1eeu) {
-                break;
-            }
-        }
-        if (i == 0xffff) {
-            pr_info("error: cannot find eocd\n");
+    // one read for the EOCD and its longest possible comment
+    tail.fp = fp;
+    tail.size = i_size_read(file_inode(fp));
+    tail.len = min_t(loff_t, tail.size, APK_EOCD_SIZE + APK_MAX_COMMENT);
+    tail.start = tail.size - tail.len;
+    tail.buf = vmalloc(tail.len ? tail.len : 1);
+    if (!tail.buf) {
+        ret = -ENOMEM;
+        goto clean;
+    }
+    {
+        loff_t pos = tail.start;
+        if (kernel_read(fp, tail.buf, tail.len, &pos) != tail.len) {
+            ret = -EIO;
             goto clean;
         }
     }
 
-    pos += 12;
-    // offset
-    kernel_read(fp, &size4, 0x4, &pos);
-    pos = size4 - 0x18;
+    eocd = apk_find_eocd(&tail);
+    if (!eocd) {
+        pr_info("error: cannot find eocd\n");
+        goto clean;
+    }
+
+    cd_offset = get_unaligned_le32(eocd + 16);
+    if (cd_offset < APK_SIG_FOOTER_SIZE ||
+        cd_offset > tail.start + (eocd - tail.buf))
+        goto clean;
 
-    kernel_read(fp, &size8, 0x8, &pos);
-    kernel_read(fp, buffer, 0x10, &pos);
-    if (strcmp((char *)buffer, "APK Sig Block 42")) {
+    footer = apk_read_range(&tail, cd_offset - APK_SIG_FOOTER_SIZE,
+                            APK_SIG_FOOTER_SIZE, &footer_alloc);
+    if (IS_ERR(footer)) {
+        ret = PTR_ERR(footer);
         goto clean;
     }
+    if (!footer || memcmp(footer + 8, APK_SIG_BLOCK_MAGIC, 16))
+        goto clean;
+
+    // the size excludes its own leading copy
+    size_of_block = get_unaligned_le64(footer);
+    if (size_of_block < APK_SIG_FOOTER_SIZE ||
+        size_of_block > APK_SIG_BLOCK_MAX || size_of_block + 8 > cd_offset)
+        goto clean;
 
-    pos = size4 - (size8 + 0x8);
-    kernel_read(fp, &size_of_block, 0x8, &pos);
-    if (size_of_block != size8) {
+    block = apk_read_range(&tail, cd_offset - (size_of_block + 8),
+                           size_of_block + 8, &block_alloc);
+    if (IS_ERR(block)) {
+        ret = PTR_ERR(block);
         goto clean;
     }
+    if (!block || get_unaligned_le64(block) != size_of_block)
+        goto clean;
+
+    // id-value pairs sit between the two size fields
+    pairs.p = block + 8;
+    pairs.end = block + 8 + size_of_block - APK_SIG_FOOTER_SIZE;
+    while (pairs.p < pairs.end) {
+        u64 len;
+        u32 id;
 
-    int loop_count = 0;
-    while (loop_count++ < 10) {
-        uint32_t id;
-        uint32_t offset;
-        kernel_read(fp, &size8, 0x8,
-                       &pos); // sequence length
-        if (size8 == size_of_block) {
+        if (!cur_u64(&pairs, &len) || len < 4 || len > pairs.end - pairs.p) {
+            pr_info("malformed apk signing block\n");
+            v2_signing_valid = false;
             break;
         }
-        kernel_read(fp, &id, 0x4, &pos); // id
-        offset = 4;
-        if (id == 0x7109871au) {
+        id = get_unaligned_le32(pairs.p);
+        if (id == APK_SIG_V2_ID) {
             v2_signing_blocks++;
-            v2_signing_valid =
-                check_block(fp, &size4, &pos, &offset);
-        } else if (id == 0xf05368c0u) {
-            // http://aospxref.com/android-14.0.0_r2/xref/frameworks/base/core/java/android/util/apk/ApkSignatureSchemeV3Verifier.java#73
+            ret = check_block(pairs.p + 4, len - 4);
+            if (ret < 0)
+                goto clean;
+            v2_signing_valid = ret;
+            ret = 0;
+        } else if (id == APK_SIG_V3_ID) {
             v3_signing_exist = true;
-        } else if (id == 0x1b93ad61u) {
-            // http://aospxref.com/android-14.0.0_r2/xref/frameworks/base/core/java/android/util/apk/ApkSignatureSchemeV3Verifier.java#74
+        } else if (id == APK_SIG_V3_1_ID) {
             v3_1_signing_exist = true;
         } else {
 #ifdef CONFIG_KSU_DEBUG
             pr_info("Unknown id: 0x%08x\n", id);
 #endif
         }
-        pos += (size8 - offset);
+        pairs.p += len;
     }
 
     if (v2_signing_blocks != 1) {
@@ -279,21 +432,28 @@ static __always_inline bool check_v2_signature(char *path)
     }
 
     if (v2_signing_valid) {
-        int has_v1_signing = has_v1_signature_file(fp);
-        if (has_v1_signing) {
+        int has_v1_signing = has_v1_signature_file(&tail, eocd);
+        if (has_v1_signing < 0) {
+            ret = has_v1_signing;
+        } else if (has_v1_signing) {
             pr_err("Unexpected v1 signature scheme found!\n");
-            filp_close(fp, 0);
-            return false;
+            v2_signing_valid = false;
         }
     }
 clean:
+    vfree(block_alloc);
+    vfree(footer_alloc);
+    vfree(tail.buf);
     filp_close(fp, 0);
 
+    if (ret < 0)
+        return ret;
+
     if (v3_signing_exist || v3_1_signing_exist) {
 #ifdef CONFIG_KSU_DEBUG
         pr_err("Unexpected v3 signature scheme found!\n");
 #endif
-        return false;
+        return 0;
     }
 
     return v2_signing_valid;
@@ -323,7 +483,31 @@ module_param_cb(ksu_debug_manager_appid, &expected_size_ops,
 
 #endif
 
-bool is_manager_apk(char *path)
+int is_manager_apk(char *path)
 {
     return check_v2_signature(path);
+}
+
+void ksu_apk_sign_exit(void)
+{
+    mutex_lock(&apk_sign_lock);
+    if (sha256_tfm) {
+        crypto_free_shash(sha256_tfm);
+        sha256_tfm = NULL;
+    }
+    mutex_unlock(&apk_sign_lock);
+}
+
+u32 ksu_apk_sign_keys_hash(void)
+{
+    u32 hash = 0;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(apk_sign_keys); i++) {
+        hash = jhash(&apk_sign_keys[i].size, sizeof(apk_sign_keys[i].size),
+                     hash);
+        hash = jhash(apk_sign_keys[i].sha256, strlen(apk_sign_keys[i].sha256),
+                     hash);
+    }
+    return hash;
 }
\ No newline at end of file
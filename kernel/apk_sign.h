@@ -3,6 +3,12 @@
 
 #include <linux/types.h>
 
-bool is_manager_apk(char *path);
+// 1 for the manager, 0 for any other APK, -errno if it couldn't be checked
+int is_manager_apk(char *path);
+
+void ksu_apk_sign_exit(void);
+
+// Identifies the set of manager keys this kernel accepts
+u32 ksu_apk_sign_keys_hash(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+
+#include "boot_timeline.h"
+
+static struct ksu_boot_phase boot_phases[KSU_BOOT_PHASE_COUNT];
+
+void ksu_boot_phase_begin(u32 phase)
+{
+    if (phase >= KSU_BOOT_PHASE_COUNT || READ_ONCE(boot_phases[phase].begin_ns))
+        return;
+
+    WRITE_ONCE(boot_phases[phase].begin_ns, ktime_get_ns());
+}
+
+void ksu_boot_phase_end(u32 phase)
+{
+    struct ksu_boot_phase *p;
+
+    if (phase >= KSU_BOOT_PHASE_COUNT)
+        return;
+
+    p = &boot_phases[phase];
+    if (!READ_ONCE(p->begin_ns) || READ_ONCE(p->end_ns))
+        return;
+
+    WRITE_ONCE(p->end_ns, ktime_get_ns());
+}
+
+void ksu_boot_event(u32 phase)
+{
+    ksu_boot_phase_begin(phase);
+    ksu_boot_phase_end(phase);
+}
+
+u32 ksu_boot_timeline_read(struct ksu_boot_phase *phases, u32 max)
+{
+    u32 i;
+
+    for (i = 0; i < min_t(u32, max, KSU_BOOT_PHASE_COUNT); i++) {
+        phases[i].begin_ns = READ_ONCE(boot_phases[i].begin_ns);
+        phases[i].end_ns = READ_ONCE(boot_phases[i].end_ns);
+    }
+    return KSU_BOOT_PHASE_COUNT;
+}
@@ -0,0 +1,16 @@
+#ifndef __KSU_H_BOOT_TIMELINE
+#define __KSU_H_BOOT_TIMELINE
+
+#include <linux/types.h>
+#include "supercalls.h"
+
+// Timestamps for the KSU_BOOT_* phases. Only the first run of a phase is
+// kept, so repeated events like module mounts don't move it around.
+void ksu_boot_phase_begin(u32 phase);
+void ksu_boot_phase_end(u32 phase);
+void ksu_boot_event(u32 phase);
+
+// Copies out up to max phases, returns how many phases there are
+u32 ksu_boot_timeline_read(struct ksu_boot_phase *phases, u32 max);
+
+#endif
@@ -1,5 +1,6 @@
 #include "feature.h"
 #include "klog.h" // IWYU pragma: keep
+#include "status_page.h"
 
 #include <linux/mutex.h>
 
@@ -7,6 +8,19 @@ static const struct ksu_feature_handler *feature_handlers[KSU_FEATURE_MAX];
 
 static DEFINE_MUTEX(feature_mutex);
 
+// Mirror the handler's current value into the status page, feature_mutex
+// must be held.
+static void feature_sync_status(u32 feature_id)
+{
+    const struct ksu_feature_handler *handler = feature_handlers[feature_id];
+    u64 value = 0;
+
+    if (handler && handler->get_handler && handler->get_handler(&value))
+        value = 0;
+
+    ksu_status_set_feature(feature_id, handler != NULL, value);
+}
+
 int ksu_register_feature_handler(const struct ksu_feature_handler *handler)
 {
     if (!handler) {
@@ -33,6 +47,7 @@ int ksu_register_feature_handler(const struct ksu_feature_handler *handler)
     }
 
     feature_handlers[handler->feature_id] = handler;
+    feature_sync_status(handler->feature_id);
 
     pr_info("feature: registered handler for %s (id=%u)\n",
             handler->name ? handler->name : "unknown", handler->feature_id);
@@ -59,6 +74,7 @@ int ksu_unregister_feature_handler(u32 feature_id)
     }
 
     feature_handlers[feature_id] = NULL;
+    feature_sync_status(feature_id);
 
     pr_info("feature: unregistered handler for id=%u\n", feature_id);
 
@@ -141,6 +157,7 @@ int ksu_set_feature(u32 feature_id, u64 value)
     if (ret) {
         pr_err("feature: set_handler for %u failed: %d\n", feature_id, ret);
     }
+    feature_sync_status(feature_id);
 
 out:
     mutex_unlock(&feature_mutex);
@@ -7,8 +7,12 @@
 #include <linux/err.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/hashtable.h>
+#include <linux/mm.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/splice.h>
 #include <linux/uaccess.h>
 #include <linux/version.h>
 #include <linux/mount.h>
@@ -21,9 +25,21 @@
 
 #include "file_wrapper.h"
 
+// Wrapper vtables are interned per original f_op, so every wrapped tty or
+// pipe of the same kind shares one. It goes away with the last wrapper.
+struct ksu_wrapper_fops {
+    struct hlist_node node;
+    const struct file_operations *orig_fops;
+    unsigned int refs;
+    struct file_operations ops;
+};
+
+static DEFINE_HASHTABLE(wrapper_fops_table, 4);
+static DEFINE_SPINLOCK(wrapper_fops_lock);
+
 struct ksu_file_wrapper {
     struct file *orig;
-    struct file_operations ops;
+    struct ksu_wrapper_fops *fops;
 };
 
 static struct ksu_file_wrapper *ksu_create_file_wrapper(struct file *fp);
@@ -42,7 +58,7 @@ static int ksu_wrapper_open(struct inode *ino, struct file *fp)
         return PTR_ERR(wrapper);
     }
     fp->private_data = wrapper;
-    const struct file_operations *new_fops = fops_get(&wrapper->ops);
+    const struct file_operations *new_fops = fops_get(&wrapper->fops->ops);
     replace_fops(fp, new_fops);
     return 0;
 }
@@ -149,10 +165,23 @@ static long ksu_wrapper_compat_ioctl(struct file *fp, unsigned int cmd,
     return orig->f_op->compat_ioctl(orig, cmd, arg);
 }
 
+// Map the original file itself, so faults and writeback go straight to its
+// mapping instead of the wrapper's anon inode.
 static int ksu_wrapper_mmap(struct file *fp, struct vm_area_struct *vma)
 {
     struct ksu_file_wrapper *data = fp->private_data;
     struct file *orig = data->orig;
+
+    if (WARN_ON(fp != vma->vm_file))
+        return -EIO;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+    vma_set_file(vma, orig);
+#else
+    // the caller drops vma->vm_file on error, whichever file it is by then
+    vma->vm_file = get_file(orig);
+    fput(fp);
+#endif
     return orig->f_op->mmap(orig, vma);
 }
 
@@ -242,10 +271,15 @@ static ssize_t ksu_wrapper_splice_read(struct file *fp, loff_t *off,
 {
     struct ksu_file_wrapper *data = fp->private_data;
     struct file *orig = data->orig;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+    // Also takes care of O_DIRECT and DAX files on the original
+    return vfs_splice_read(orig, off, pii, sz, arg1);
+#else
     if (orig->f_op->splice_read) {
         return orig->f_op->splice_read(orig, off, pii, sz, arg1);
     }
     return -EINVAL;
+#endif
 }
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
@@ -314,7 +348,21 @@ static void ksu_wrapper_show_fdinfo(struct seq_file *m, struct file *f)
     }
 }
 
+static int ksu_wrapper_release(struct inode *inode, struct file *filp);
+
+static struct file *ksu_wrapper_orig_file(struct file *fp)
+{
+    if (fp->f_op && fp->f_op->release == ksu_wrapper_release) {
+        struct ksu_file_wrapper *data = fp->private_data;
+        return data->orig;
+    }
+    return fp;
+}
+
 // https://cs.android.com/android/kernel/superproject/+/common-android-mainline:common/fs/read_write.c;l=1593-1606;drc=398da7defe218d3e51b0f3bdff75147e28125b60
+// The vfs only calls this when both ends share the method, which is the case
+// for two wrappers of the same kind, so unwrap the source too and let the
+// filesystem copy between the original files.
 static ssize_t ksu_wrapper_copy_file_range(struct file *file_in, loff_t pos_in,
                                            struct file *file_out,
                                            loff_t pos_out, size_t len,
@@ -322,8 +370,8 @@ static ssize_t ksu_wrapper_copy_file_range(struct file *file_in, loff_t pos_in,
 {
     struct ksu_file_wrapper *data = file_out->private_data;
     struct file *orig = data->orig;
-    return orig->f_op->copy_file_range(file_in, pos_in, orig, pos_out, len,
-                                       flags);
+    return orig->f_op->copy_file_range(ksu_wrapper_orig_file(file_in), pos_in,
+                                       orig, pos_out, len, flags);
 }
 
 static loff_t ksu_wrapper_remap_file_range(struct file *file_in, loff_t pos_in,
@@ -368,74 +416,149 @@ static int ksu_wrapper_release(struct inode *inode, struct file *filp)
     return 0;
 }
 
-static struct ksu_file_wrapper *ksu_create_file_wrapper(struct file *fp)
+static void ksu_fill_wrapper_fops(struct file_operations *ops,
+                                  const struct file_operations *orig)
 {
-    struct ksu_file_wrapper *p =
-        kcalloc(1, sizeof(struct ksu_file_wrapper), GFP_KERNEL);
-    if (!p) {
-        return ERR_PTR(-ENOMEM);
-    }
-
-    get_file(fp);
-
-    p->orig = fp;
-    p->ops.owner = THIS_MODULE;
-    p->ops.llseek = fp->f_op->llseek ? ksu_wrapper_llseek : NULL;
-    p->ops.read = fp->f_op->read ? ksu_wrapper_read : NULL;
-    p->ops.write = fp->f_op->write ? ksu_wrapper_write : NULL;
-    p->ops.read_iter = fp->f_op->read_iter ? ksu_wrapper_read_iter : NULL;
-    p->ops.write_iter = fp->f_op->write_iter ? ksu_wrapper_write_iter : NULL;
-    p->ops.iopoll = fp->f_op->iopoll ? ksu_wrapper_iopoll : NULL;
+    ops->owner = THIS_MODULE;
+    ops->llseek = orig->llseek ? ksu_wrapper_llseek : NULL;
+    ops->read = orig->read ? ksu_wrapper_read : NULL;
+    ops->write = orig->write ? ksu_wrapper_write : NULL;
+    ops->read_iter = orig->read_iter ? ksu_wrapper_read_iter : NULL;
+    ops->write_iter = orig->write_iter ? ksu_wrapper_write_iter : NULL;
+    ops->iopoll = orig->iopoll ? ksu_wrapper_iopoll : NULL;
 #if LINUX_VERSION_CODE < KERNEL_VERSION(6, 6, 0)
-    p->ops.iterate = fp->f_op->iterate ? ksu_wrapper_iterate : NULL;
+    ops->iterate = orig->iterate ? ksu_wrapper_iterate : NULL;
 #endif
-    p->ops.iterate_shared =
-        fp->f_op->iterate_shared ? ksu_wrapper_iterate_shared : NULL;
-    p->ops.poll = fp->f_op->poll ? ksu_wrapper_poll : NULL;
-    p->ops.unlocked_ioctl =
-        fp->f_op->unlocked_ioctl ? ksu_wrapper_unlocked_ioctl : NULL;
-    p->ops.compat_ioctl =
-        fp->f_op->compat_ioctl ? ksu_wrapper_compat_ioctl : NULL;
-    p->ops.mmap = fp->f_op->mmap ? ksu_wrapper_mmap : NULL;
+    ops->iterate_shared =
+        orig->iterate_shared ? ksu_wrapper_iterate_shared : NULL;
+    ops->poll = orig->poll ? ksu_wrapper_poll : NULL;
+    ops->unlocked_ioctl =
+        orig->unlocked_ioctl ? ksu_wrapper_unlocked_ioctl : NULL;
+    ops->compat_ioctl = orig->compat_ioctl ? ksu_wrapper_compat_ioctl : NULL;
+    ops->mmap = orig->mmap ? ksu_wrapper_mmap : NULL;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
-    p->ops.fop_flags = fp->f_op->fop_flags;
+    ops->fop_flags = orig->fop_flags;
 #else
-    p->ops.mmap_supported_flags = fp->f_op->mmap_supported_flags;
+    ops->mmap_supported_flags = orig->mmap_supported_flags;
 #endif
-    p->ops.flush = fp->f_op->flush ? ksu_wrapper_flush : NULL;
-    p->ops.release = ksu_wrapper_release;
-    p->ops.fsync = fp->f_op->fsync ? ksu_wrapper_fsync : NULL;
-    p->ops.fasync = fp->f_op->fasync ? ksu_wrapper_fasync : NULL;
-    p->ops.lock = fp->f_op->lock ? ksu_wrapper_lock : NULL;
+    ops->flush = orig->flush ? ksu_wrapper_flush : NULL;
+    ops->release = ksu_wrapper_release;
+    ops->fsync = orig->fsync ? ksu_wrapper_fsync : NULL;
+    ops->fasync = orig->fasync ? ksu_wrapper_fasync : NULL;
+    ops->lock = orig->lock ? ksu_wrapper_lock : NULL;
 #if LINUX_VERSION_CODE < KERNEL_VERSION(6, 6, 0)
-    p->ops.sendpage = fp->f_op->sendpage ? ksu_wrapper_sendpage : NULL;
+    ops->sendpage = orig->sendpage ? ksu_wrapper_sendpage : NULL;
 #endif
-    p->ops.get_unmapped_area =
-        fp->f_op->get_unmapped_area ? ksu_wrapper_get_unmapped_area : NULL;
-    p->ops.check_flags = fp->f_op->check_flags;
-    p->ops.flock = fp->f_op->flock ? ksu_wrapper_flock : NULL;
-    p->ops.splice_write =
-        fp->f_op->splice_write ? ksu_wrapper_splice_write : NULL;
-    p->ops.splice_read = fp->f_op->splice_read ? ksu_wrapper_splice_read : NULL;
-    p->ops.setlease = fp->f_op->setlease ? ksu_wrapper_setlease : NULL;
-    p->ops.fallocate = fp->f_op->fallocate ? ksu_wrapper_fallocate : NULL;
-    p->ops.show_fdinfo = fp->f_op->show_fdinfo ? ksu_wrapper_show_fdinfo : NULL;
-    p->ops.copy_file_range =
-        fp->f_op->copy_file_range ? ksu_wrapper_copy_file_range : NULL;
-    p->ops.remap_file_range =
-        fp->f_op->remap_file_range ? ksu_wrapper_remap_file_range : NULL;
-    p->ops.fadvise = fp->f_op->fadvise ? ksu_wrapper_fadvise : NULL;
+    ops->get_unmapped_area =
+        orig->get_unmapped_area ? ksu_wrapper_get_unmapped_area : NULL;
+    ops->check_flags = orig->check_flags;
+    ops->flock = orig->flock ? ksu_wrapper_flock : NULL;
+    ops->splice_write = orig->splice_write ? ksu_wrapper_splice_write : NULL;
+    ops->splice_read = orig->splice_read ? ksu_wrapper_splice_read : NULL;
+    ops->setlease = orig->setlease ? ksu_wrapper_setlease : NULL;
+    ops->fallocate = orig->fallocate ? ksu_wrapper_fallocate : NULL;
+    ops->show_fdinfo = orig->show_fdinfo ? ksu_wrapper_show_fdinfo : NULL;
+    ops->copy_file_range =
+        orig->copy_file_range ? ksu_wrapper_copy_file_range : NULL;
+    ops->remap_file_range =
+        orig->remap_file_range ? ksu_wrapper_remap_file_range : NULL;
+    ops->fadvise = orig->fadvise ? ksu_wrapper_fadvise : NULL;
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
-    p->ops.splice_eof = fp->f_op->splice_eof ? ksu_wrapper_splice_eof : NULL;
+    ops->splice_eof = orig->splice_eof ? ksu_wrapper_splice_eof : NULL;
 #endif
+}
 
+static struct ksu_wrapper_fops *
+ksu_find_wrapper_fops_locked(const struct file_operations *orig_fops)
+{
+    struct ksu_wrapper_fops *fops;
+
+    hash_for_each_possible (wrapper_fops_table, fops, node,
+                            (unsigned long)orig_fops) {
+        if (fops->orig_fops == orig_fops) {
+            fops->refs++;
+            return fops;
+        }
+    }
+    return NULL;
+}
+
+static struct ksu_wrapper_fops *
+ksu_get_wrapper_fops(const struct file_operations *orig_fops)
+{
+    struct ksu_wrapper_fops *fops, *new;
+
+    spin_lock(&wrapper_fops_lock);
+    fops = ksu_find_wrapper_fops_locked(orig_fops);
+    spin_unlock(&wrapper_fops_lock);
+    if (fops) {
+        return fops;
+    }
+
+    new = kzalloc(sizeof(*new), GFP_KERNEL);
+    if (!new) {
+        return ERR_PTR(-ENOMEM);
+    }
+    new->orig_fops = orig_fops;
+    new->refs = 1;
+    ksu_fill_wrapper_fops(&new->ops, orig_fops);
+
+    spin_lock(&wrapper_fops_lock);
+    // someone else may have added it in the meantime
+    fops = ksu_find_wrapper_fops_locked(orig_fops);
+    if (!fops) {
+        hash_add(wrapper_fops_table, &new->node, (unsigned long)orig_fops);
+        fops = new;
+        new = NULL;
+    }
+    spin_unlock(&wrapper_fops_lock);
+
+    kfree(new);
+    return fops;
+}
+
+static void ksu_put_wrapper_fops(struct ksu_wrapper_fops *fops)
+{
+    spin_lock(&wrapper_fops_lock);
+    if (--fops->refs) {
+        spin_unlock(&wrapper_fops_lock);
+        return;
+    }
+    hash_del(&fops->node);
+    spin_unlock(&wrapper_fops_lock);
+
+    kfree(fops);
+}
+
+static struct ksu_file_wrapper *ksu_create_file_wrapper(struct file *fp)
+{
+    struct ksu_wrapper_fops *fops;
+    struct ksu_file_wrapper *p =
+        kcalloc(1, sizeof(struct ksu_file_wrapper), GFP_KERNEL);
+    if (!p) {
+        return ERR_PTR(-ENOMEM);
+    }
+
+    // The original file holds a reference to its f_op owner, so the key
+    // stays valid for as long as any wrapper of it is around.
+    fops = ksu_get_wrapper_fops(fp->f_op);
+    if (IS_ERR(fops)) {
+        kfree(p);
+        return ERR_CAST(fops);
+    }
+
+    get_file(fp);
+
+    p->orig = fp;
+    p->fops = fops;
     return p;
 }
 
 static void ksu_release_file_wrapper(struct ksu_file_wrapper *data)
 {
     fput((struct file *)data->orig);
+    ksu_put_wrapper_fops(data->fops);
     kfree(data);
 }
 
@@ -550,7 +673,7 @@ int ksu_install_file_wrapper(int fd)
     }
 
     struct file *wrapper_file = ksu_anon_inode_create_getfile_compat(
-        "[ksu_fdwrapper]", &file_wrapper_data->ops, file_wrapper_data,
+        "[ksu_fdwrapper]", &file_wrapper_data->fops->ops, file_wrapper_data,
         orig_file->f_flags, NULL);
     if (IS_ERR(wrapper_file)) {
         pr_err("ksu_fdwrapper: getfile failed: %ld\n", PTR_ERR(wrapper_file));
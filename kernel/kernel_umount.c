@@ -1,3 +1,5 @@
+#include <linux/bitmap.h>
+#include <linux/jiffies.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/task_work.h>
@@ -7,7 +9,11 @@
 #include <linux/namei.h>
 #include <linux/nsproxy.h>
 #include <linux/path.h>
+#include <linux/pid.h>
 #include <linux/printk.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
 #include <linux/types.h>
 
 #include "kernel_umount.h"
@@ -53,49 +59,378 @@ static void ksu_umount_mnt(struct path *path, int flags)
     }
 }
 
-void try_umount(const char *mnt, int flags)
+// Returns false if there is nothing mounted at mnt (anymore)
+static bool __try_umount(const char *mnt, int flags)
 {
     struct path path;
     int err = kern_path(mnt, 0, &path);
     if (err) {
-        return;
+        return false;
     }
 
     if (path.dentry != path.mnt->mnt_root) {
         // it is not root mountpoint, maybe umounted by others already.
         path_put(&path);
-        return;
+        return false;
     }
 
     ksu_umount_mnt(&path, flags);
+    return true;
+}
+
+void try_umount(const char *mnt, int flags)
+{
+    __try_umount(mnt, flags);
+}
+
+/*
+ * The umount plan is mount_list compiled for the app launch path: paths are
+ * normalized, deduplicated and sorted deepest-first so that nested mounts go
+ * before their parents. It is rebuilt lazily after the list changes and is
+ * protected by mount_list_lock like the list itself.
+ *
+ * Entries that turned out to be gone are remembered per zygote, so the
+ * children of the same zygote skip their path lookups. A zygote keeps its
+ * mount namespace once it forks apps, so it stands for that namespace; the
+ * key is a reference to its struct pid, which a restarted zygote can't get
+ * back, unlike the address of a freed namespace. That memory expires after
+ * UMOUNT_GONE_TTL and whenever modules get mounted, since a mount may
+ * reappear.
+ */
+#define UMOUNT_GONE_TTL (10 * HZ)
+
+struct umount_plan_entry {
+    const char *path;
+    unsigned int flags;
+    unsigned int depth;
+    unsigned int index;
+};
+
+struct umount_plan {
+    unsigned int nr;
+    spinlock_t gone_lock;
+    struct pid *gone_zygote; // holds a reference
+    unsigned long gone_stamp;
+    u32 gone_seq;
+    unsigned long *gone;
+    struct umount_plan_entry entries[];
+};
+
+static struct umount_plan *umount_plan;
+static bool umount_plan_stale = true;
+
+/*
+ * What ksu_handle_umount may look at without mount_list_lock, so that no
+ * task_work is queued when there is nothing to unmount: whether the list is
+ * empty, and the zygote for whose children every planned entry was seen
+ * gone, until when that holds.
+ */
+static bool umount_list_empty = true;
+static DEFINE_SPINLOCK(umount_idle_lock);
+static struct pid *umount_idle_zygote; // holds a reference
+static unsigned long umount_idle_until;
+
+static void umount_idle_set(struct pid *zygote, unsigned long until)
+{
+    struct pid *old;
+
+    spin_lock(&umount_idle_lock);
+    old = umount_idle_zygote;
+    umount_idle_zygote = get_pid(zygote);
+    umount_idle_until = until;
+    spin_unlock(&umount_idle_lock);
+
+    put_pid(old);
+}
+
+static bool zygote_exited(struct pid *zygote)
+{
+    bool exited;
+
+    rcu_read_lock();
+    exited = !pid_task(zygote, PIDTYPE_PID);
+    rcu_read_unlock();
+
+    return exited;
+}
+
+static bool umount_idle(struct pid *zygote)
+{
+    struct pid *stale = NULL;
+    bool idle = false;
+
+    if (!zygote)
+        return false;
+
+    spin_lock(&umount_idle_lock);
+    if (umount_idle_zygote == zygote) {
+        idle = time_before(jiffies, umount_idle_until);
+    } else if (umount_idle_zygote && zygote_exited(umount_idle_zygote)) {
+        // zygote restarted, the key can never match again
+        stale = umount_idle_zygote;
+        umount_idle_zygote = NULL;
+    }
+    spin_unlock(&umount_idle_lock);
+
+    put_pid(stale);
+    return idle;
+}
+
+static void normalize_path(char *dst, const char *src)
+{
+    char *p = dst;
+
+    for (; *src; src++) {
+        if (*src == '/' && p > dst && p[-1] == '/')
+            continue;
+        *p++ = *src;
+    }
+    while (p > dst + 1 && p[-1] == '/')
+        p--;
+    *p = '\0';
+}
+
+static unsigned int path_depth(const char *path)
+{
+    unsigned int depth = 0;
+
+    for (; *path; path++)
+        if (*path == '/')
+            depth++;
+    return depth;
+}
+
+static int plan_entry_cmp(const void *a, const void *b)
+{
+    const struct umount_plan_entry *x = a, *y = b;
+    int ret;
+
+    if (x->depth != y->depth)
+        return x->depth > y->depth ? -1 : 1;
+    ret = strcmp(x->path, y->path);
+    if (ret)
+        return ret;
+    // same path twice, keep the one the list walk used to see first
+    return x->index < y->index ? -1 : 1;
+}
+
+// mount_list_lock must be held for writing
+static struct umount_plan *umount_plan_build(void)
+{
+    struct umount_plan *plan;
+    struct mount_entry *entry;
+    unsigned int nr = 0, i, j;
+    size_t head, size, strings = 0;
+    char *str;
+
+    list_for_each_entry (entry, &mount_list, list) {
+        nr++;
+        strings += strlen(entry->umountable) + 1;
+    }
+
+    head = ALIGN(sizeof(*plan) + nr * sizeof(plan->entries[0]), sizeof(long));
+    size = head + BITS_TO_LONGS(nr) * sizeof(long);
+    plan = kzalloc(size + strings, GFP_KERNEL);
+    if (!plan)
+        return NULL;
+
+    spin_lock_init(&plan->gone_lock);
+    plan->gone = (unsigned long *)((char *)plan + head);
+    str = (char *)plan + size;
+
+    i = 0;
+    list_for_each_entry (entry, &mount_list, list) {
+        normalize_path(str, entry->umountable);
+        plan->entries[i].path = str;
+        plan->entries[i].flags = entry->flags;
+        plan->entries[i].depth = path_depth(str);
+        plan->entries[i].index = i;
+        str += strlen(str) + 1;
+        i++;
+    }
+
+    sort(plan->entries, nr, sizeof(plan->entries[0]), plan_entry_cmp, NULL);
+
+    for (i = 0, j = 0; i < nr; i++) {
+        if (j && !strcmp(plan->entries[j - 1].path, plan->entries[i].path))
+            continue;
+        plan->entries[j++] = plan->entries[i];
+    }
+    plan->nr = j;
+
+    return plan;
+}
+
+// Called with mount_list_lock held for writing whenever mount_list changes
+void ksu_umount_list_changed(void)
+{
+    if (umount_plan) {
+        put_pid(umount_plan->gone_zygote);
+        kfree(umount_plan);
+        umount_plan = NULL;
+    }
+    umount_plan_stale = true;
+
+    WRITE_ONCE(umount_list_empty, list_empty(&mount_list));
+    umount_idle_set(NULL, 0);
+}
+
+// Returns with mount_list_lock held for reading
+static struct umount_plan *umount_plan_get(void)
+{
+    down_read(&mount_list_lock);
+    if (likely(!umount_plan_stale))
+        return umount_plan;
+    up_read(&mount_list_lock);
+
+    down_write(&mount_list_lock);
+    if (umount_plan_stale) {
+        umount_plan = umount_plan_build();
+        // on allocation failure we just try again next time
+        umount_plan_stale = !umount_plan;
+    }
+    downgrade_write(&mount_list_lock);
+
+    return umount_plan;
+}
+
+static u32 umount_plan_gone_snapshot(struct umount_plan *plan,
+                                     struct pid *zygote, unsigned long *gone)
+{
+    u32 seq;
+
+    spin_lock(&plan->gone_lock);
+    if (zygote && plan->gone_zygote == zygote &&
+        time_before(jiffies, plan->gone_stamp + UMOUNT_GONE_TTL))
+        bitmap_copy(gone, plan->gone, plan->nr);
+    else
+        bitmap_zero(gone, plan->nr);
+    seq = plan->gone_seq;
+    spin_unlock(&plan->gone_lock);
+
+    return seq;
+}
+
+static void umount_plan_gone_update(struct umount_plan *plan,
+                                    struct pid *zygote, u32 seq,
+                                    const unsigned long *gone)
+{
+    struct pid *old = NULL;
+
+    if (!zygote)
+        return;
+
+    spin_lock(&plan->gone_lock);
+    // modules were mounted in between, what we saw may be outdated
+    if (plan->gone_seq != seq)
+        goto out;
+
+    if (plan->gone_zygote == zygote &&
+        time_before(jiffies, plan->gone_stamp + UMOUNT_GONE_TTL)) {
+        bitmap_or(plan->gone, plan->gone, gone, plan->nr);
+    } else {
+        old = plan->gone_zygote;
+        plan->gone_zygote = get_pid(zygote);
+        plan->gone_stamp = jiffies;
+        plan->gone_seq++;
+        bitmap_copy(plan->gone, gone, plan->nr);
+    }
+
+    // nothing left to do for the children of this zygote
+    if (bitmap_full(plan->gone, plan->nr))
+        umount_idle_set(zygote, plan->gone_stamp + UMOUNT_GONE_TTL);
+out:
+    spin_unlock(&plan->gone_lock);
+
+    put_pid(old);
+}
+
+void ksu_umount_plan_invalidate_gone(void)
+{
+    struct pid *old = NULL;
+
+    down_read(&mount_list_lock);
+    if (umount_plan) {
+        spin_lock(&umount_plan->gone_lock);
+        old = umount_plan->gone_zygote;
+        umount_plan->gone_zygote = NULL;
+        umount_plan->gone_seq++;
+        spin_unlock(&umount_plan->gone_lock);
+    }
+    umount_idle_set(NULL, 0);
+    up_read(&mount_list_lock);
+
+    put_pid(old);
+}
+
+// A reference to the zygote we were forked from, the key for what is gone
+// in its mount namespace; by the time of setresuid the child already
+// unshared its own copy of it.
+static struct pid *get_zygote_pid(void)
+{
+    struct pid *zygote;
+
+    rcu_read_lock();
+    zygote = get_pid(task_tgid(rcu_dereference(current->real_parent)));
+    rcu_read_unlock();
+
+    return zygote;
 }
 
 struct umount_tw {
     struct callback_head cb;
+    struct pid *zygote;
 };
 
 static void umount_tw_func(struct callback_head *cb)
 {
     struct umount_tw *tw = container_of(cb, struct umount_tw, cb);
     const struct cred *saved = override_creds(ksu_cred);
+    struct umount_plan *plan;
+    unsigned long *gone = NULL;
+    unsigned int i, skipped = 0;
+    u32 seq = 0;
 
-    struct mount_entry *entry;
-    down_read(&mount_list_lock);
-    list_for_each_entry (entry, &mount_list, list) {
-        pr_info("%s: unmounting: %s flags 0x%x\n", __func__, entry->umountable,
+    plan = umount_plan_get();
+    if (!plan || !plan->nr)
+        goto out;
+
+    gone = kcalloc(BITS_TO_LONGS(plan->nr), sizeof(long), GFP_KERNEL);
+    if (gone)
+        seq = umount_plan_gone_snapshot(plan, tw->zygote, gone);
+
+    for (i = 0; i < plan->nr; i++) {
+        const struct umount_plan_entry *entry = &plan->entries[i];
+
+        if (gone && test_bit(i, gone)) {
+            skipped++;
+            continue;
+        }
+        pr_info("%s: unmounting: %s flags 0x%x\n", __func__, entry->path,
                 entry->flags);
-        try_umount(entry->umountable, entry->flags);
+        if (!__try_umount(entry->path, entry->flags) && gone)
+            __set_bit(i, gone);
     }
+
+    if (gone)
+        umount_plan_gone_update(plan, tw->zygote, seq, gone);
+    if (skipped)
+        pr_info("%s: skipped %u gone mountpoints\n", __func__, skipped);
+
+out:
     up_read(&mount_list_lock);
+    kfree(gone);
 
     revert_creds(saved);
 
+    put_pid(tw->zygote);
     kfree(tw);
 }
 
 int ksu_handle_umount(uid_t old_uid, uid_t new_uid)
 {
     struct umount_tw *tw;
+    struct pid *zygote;
 
     // if there isn't any module mounted, just ignore it!
     if (!ksu_module_mounted) {
@@ -110,6 +445,10 @@ int ksu_handle_umount(uid_t old_uid, uid_t new_uid)
         return 0;
     }
 
+    if (READ_ONCE(umount_list_empty)) {
+        return 0;
+    }
+
     // There are 5 scenarios:
     // 1. Normal app: zygote -> appuid
     // 2. Isolated process forked from zygote: zygote -> isolated_process
@@ -136,17 +475,29 @@ int ksu_handle_umount(uid_t old_uid, uid_t new_uid)
 #if __SULOG_GATE
     ksu_sulog_report_syscall(new_uid, NULL, "setuid", NULL);
 #endif
+
+    // every listed mount is already gone in this zygote's namespace
+    zygote = get_zygote_pid();
+    if (umount_idle(zygote)) {
+        put_pid(zygote);
+        return 0;
+    }
+
     // umount the target mnt
     pr_info("handle umount for uid: %d, pid: %d\n", new_uid, current->pid);
 
     tw = kzalloc(sizeof(*tw), GFP_ATOMIC);
-    if (!tw)
+    if (!tw) {
+        put_pid(zygote);
         return 0;
+    }
 
     tw->cb.func = umount_tw_func;
+    tw->zygote = zygote;
 
     int err = task_work_add(current, &tw->cb, TWA_RESUME);
     if (err) {
+        put_pid(zygote);
         kfree(tw);
         pr_warn("unmount add task_work failed\n");
     }
@@ -164,4 +515,8 @@ void ksu_kernel_umount_init(void)
 void ksu_kernel_umount_exit(void)
 {
     ksu_unregister_feature_handler(KSU_FEATURE_KERNEL_UMOUNT);
+
+    down_write(&mount_list_lock);
+    ksu_umount_list_changed();
+    up_write(&mount_list_lock);
 }
\ No newline at end of file
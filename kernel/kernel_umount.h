@@ -10,6 +10,11 @@ void ksu_kernel_umount_exit(void);
 
 void try_umount(const char *mnt, int flags);
 
+// Drop the cached umount plan, mount_list_lock must be held for writing
+void ksu_umount_list_changed(void);
+// Forget which mountpoints were seen gone, e.g. after modules got mounted
+void ksu_umount_plan_invalidate_gone(void);
+
 // Handler function to be called from setresuid hook
 int ksu_handle_umount(uid_t old_uid, uid_t new_uid);
 
@@ -17,7 +22,9 @@ int ksu_handle_umount(uid_t old_uid, uid_t new_uid);
 struct mount_entry {
     char *umountable;
     unsigned int flags;
+    u32 hash;
     struct list_head list;
+    struct hlist_node hnode;
 };
 extern struct list_head mount_list;
 extern struct rw_semaphore mount_list_lock;
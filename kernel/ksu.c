@@ -5,6 +5,8 @@
 #include <linux/workqueue.h>
 
 #include "allowlist.h"
+#include "apk_sign.h"
+#include "boot_timeline.h"
 #include "feature.h"
 #include "klog.h" // IWYU pragma: keep
 #include "throne_tracker.h"
@@ -13,6 +15,10 @@
 #include "supercalls.h"
 #include "ksu.h"
 #include "file_wrapper.h"
+#include "status_page.h"
+#ifdef CONFIG_KSU_MANUAL_SU
+#include "manual_su.h"
+#endif
 
 struct cred *ksu_cred;
 
@@ -41,6 +47,8 @@ int __init kernelsu_init(void)
     pr_alert("*************************************************************");
 #endif
 
+    ksu_boot_phase_begin(KSU_BOOT_MODULE_INIT);
+
     ksu_cred = prepare_creds();
     if (!ksu_cred) {
         pr_err("prepare cred failed!\n");
@@ -48,6 +56,8 @@ int __init kernelsu_init(void)
 
     ksu_feature_init();
 
+    ksu_status_page_init();
+
     ksu_supercalls_init();
 
     sukisu_custom_config_init();
@@ -67,6 +77,8 @@ int __init kernelsu_init(void)
     kobject_del(&THIS_MODULE->mkobj.kobj);
 #endif
 #endif
+
+    ksu_boot_phase_end(KSU_BOOT_MODULE_INIT);
     return 0;
 }
 
@@ -75,20 +87,29 @@ void kernelsu_exit(void)
 {
     ksu_allowlist_exit();
 
+    // stop new package events before the tracker goes away
+    ksu_observer_exit();
+
     ksu_throne_tracker_exit();
 
-    ksu_observer_exit();
+    ksu_apk_sign_exit();
 
     ksu_ksud_exit();
 
     ksu_syscall_hook_manager_exit();
 
+#ifdef CONFIG_KSU_MANUAL_SU
+    ksu_manual_su_exit();
+#endif
+
     sukisu_custom_config_exit();
 
     ksu_supercalls_exit();
 
     ksu_feature_exit();
 
+    ksu_status_page_exit();
+
     if (ksu_cred) {
         put_cred(ksu_cred);
     }
@@ -20,8 +20,10 @@
 #include "manager.h"
 #include "allowlist.h"
 #include "arch.h"
+#include "boot_timeline.h"
 #include "klog.h" // IWYU pragma: keep
 #include "ksud.h"
+#include "kernel_umount.h"
 #include "util.h"
 #include "selinux/selinux.h"
 #include "throne_tracker.h"
@@ -61,6 +63,10 @@ static struct work_struct stop_vfs_read_work;
 static struct work_struct stop_execve_hook_work;
 static struct work_struct stop_input_hook_work;
 
+static bool vfs_read_hook_stopped;
+// reads by init that got past the cheap checks, reported on teardown
+static unsigned int vfs_read_init_count;
+
 u32 ksu_file_sid;
 void on_post_fs_data(void)
 {
@@ -71,13 +77,25 @@ void on_post_fs_data(void)
     }
     done = true;
     pr_info("on_post_fs_data!\n");
+    ksu_boot_phase_begin(KSU_BOOT_POST_FS_DATA);
+
+    ksu_boot_phase_begin(KSU_BOOT_LOAD_ALLOW_LIST);
     ksu_load_allow_list();
+    ksu_boot_phase_end(KSU_BOOT_LOAD_ALLOW_LIST);
+
+    ksu_throne_tracker_load_cache();
+
+    ksu_boot_phase_begin(KSU_BOOT_OBSERVER_INIT);
     ksu_observer_init();
+    ksu_boot_phase_end(KSU_BOOT_OBSERVER_INIT);
+
     // sanity check, this may influence the performance
     stop_input_hook();
 
     ksu_file_sid = ksu_get_ksu_file_sid();
     pr_info("ksu_file sid: %d\n", ksu_file_sid);
+
+    ksu_boot_phase_end(KSU_BOOT_POST_FS_DATA);
 }
 
 extern void ext4_unregister_sysfs(struct super_block *sb);
@@ -106,14 +124,18 @@ int nuke_ext4_sysfs(const char *mnt)
 void on_module_mounted(void)
 {
     pr_info("on_module_mounted!\n");
+    ksu_boot_event(KSU_BOOT_MODULE_MOUNTED);
     ksu_module_mounted = true;
+    ksu_umount_plan_invalidate_gone();
 }
 
 void on_boot_completed(void)
 {
     ksu_boot_completed = true;
     pr_info("on_boot_completed!\n");
+    ksu_boot_phase_begin(KSU_BOOT_COMPLETED);
     track_throne(true);
+    ksu_boot_phase_end(KSU_BOOT_COMPLETED);
 }
 
 #define MAX_ARG_STRINGS 0x7FFFFFFF
@@ -229,7 +251,10 @@ int ksu_handle_execveat_ksud(int *fd, struct filename **filename_ptr,
                 pr_info("/system/bin/init first arg: %s\n", first_arg);
                 if (!strcmp(first_arg, "second_stage")) {
                     pr_info("/system/bin/init second_stage executed\n");
+                    ksu_boot_event(KSU_BOOT_SECOND_STAGE);
+                    ksu_boot_phase_begin(KSU_BOOT_SEPOLICY);
                     apply_kernelsu_rules();
+                    ksu_boot_phase_end(KSU_BOOT_SEPOLICY);
                     setup_ksu_cred();
                     init_second_stage_executed = true;
                 }
@@ -242,6 +267,7 @@ int ksu_handle_execveat_ksud(int *fd, struct filename **filename_ptr,
     if (unlikely(first_app_process && !memcmp(filename->name, app_process,
                                               sizeof(app_process) - 1))) {
         first_app_process = false;
+        ksu_boot_event(KSU_BOOT_FIRST_APP_PROCESS);
         pr_info("exec app_process, /data prepared, second_stage: %d\n",
                 init_second_stage_executed);
         struct task_struct *init_task;
@@ -254,6 +280,9 @@ int ksu_handle_execveat_ksud(int *fd, struct filename **filename_ptr,
         rcu_read_unlock();
 
         stop_execve_hook();
+        // init has parsed its rc files long before zygote, drop the read
+        // hook even if atrace.rc never showed up
+        stop_vfs_read_hook();
     }
 
     return 0;
@@ -324,14 +353,8 @@ static int ksu_handle_vfs_read(struct file **file_ptr, char __user **buf_ptr,
         return 0;
     }
 
-    // we only process the first read
-    static bool rc_inserted = false;
-    if (rc_inserted) {
-        // we don't need this kprobe, unregister it!
-        stop_vfs_read_hook();
-        return 0;
-    }
-    rc_inserted = true;
+    // we only process the first read, the hook is done after this
+    stop_vfs_read_hook();
 
     // now we can sure that the init process is reading
     // `/system/etc/init/atrace.rc`
@@ -379,6 +402,13 @@ static int ksu_handle_vfs_read(struct file **file_ptr, char __user **buf_ptr,
 static int ksu_handle_sys_read(unsigned int fd, char __user **buf_ptr,
                                size_t *count_ptr)
 {
+    // This runs for every read() in the system until the hook goes away,
+    // so get rid of everything but init before touching the fd table.
+    if (likely(current->tgid != 1) || READ_ONCE(vfs_read_hook_stopped)) {
+        return 0;
+    }
+    vfs_read_init_count++;
+
     struct file *file = fget(fd);
     if (!file) {
         return 0;
@@ -429,6 +459,7 @@ bool ksu_is_safe_mode()
         // pressed over 3 times
         pr_info("KEY_VOLUMEDOWN pressed max times, safe mode detected!\n");
         safe_mode = true;
+        ksu_status_set_safe_mode(true);
         return true;
     }
 
@@ -506,21 +537,32 @@ static struct kprobe input_event_kp = {
 
 static void do_stop_vfs_read_hook(struct work_struct *work)
 {
+    ksu_boot_phase_begin(KSU_BOOT_STOP_VFS_READ_HOOK);
     unregister_kprobe(&vfs_read_kp);
+    ksu_boot_phase_end(KSU_BOOT_STOP_VFS_READ_HOOK);
+    pr_info("vfs_read kprobe unregistered, init reads inspected: %u\n",
+            vfs_read_init_count);
 }
 
 static void do_stop_execve_hook(struct work_struct *work)
 {
+    ksu_boot_phase_begin(KSU_BOOT_STOP_EXECVE_HOOK);
     unregister_kprobe(&execve_kp);
+    ksu_boot_phase_end(KSU_BOOT_STOP_EXECVE_HOOK);
 }
 
 static void do_stop_input_hook(struct work_struct *work)
 {
+    ksu_boot_phase_begin(KSU_BOOT_STOP_INPUT_HOOK);
     unregister_kprobe(&input_event_kp);
+    ksu_boot_phase_end(KSU_BOOT_STOP_INPUT_HOOK);
 }
 
 static void stop_vfs_read_hook()
 {
+    if (xchg(&vfs_read_hook_stopped, true)) {
+        return;
+    }
     bool ret = schedule_work(&stop_vfs_read_work);
     pr_info("unregister vfs_read kprobe: %d!\n", ret);
 }
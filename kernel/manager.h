@@ -4,6 +4,7 @@
 #include <linux/cred.h>
 #include <linux/types.h>
 #include "allowlist.h"
+#include "status_page.h"
 
 #define KSU_INVALID_APPID -1
 
@@ -27,11 +28,13 @@ static inline uid_t ksu_get_manager_appid()
 static inline void ksu_set_manager_appid(uid_t appid)
 {
     ksu_manager_appid = appid;
+    ksu_status_set_manager_appid(appid);
 }
 
 static inline void ksu_invalidate_manager_uid()
 {
     ksu_manager_appid = KSU_INVALID_APPID;
+    ksu_status_set_manager_appid(KSU_INVALID_APPID);
 }
 
 int ksu_observer_init(void);
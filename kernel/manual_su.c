@@ -8,6 +8,11 @@
 #include <linux/mm.h>
 #include <linux/slab.h>
 #include <linux/binfmts.h>
+#include <linux/hashtable.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
 
 #include "manual_su.h"
 #include "ksu.h"
@@ -19,9 +24,21 @@ static bool current_verified = false;
 static void ksu_cleanup_expired_tokens(void);
 static bool is_current_verified(void);
 static void add_pending_root(uid_t uid);
+static void remove_pending_root(uid_t uid);
 
-static struct pending_uid pending_uids[MAX_PENDING] = { 0 };
+DEFINE_STATIC_KEY_FALSE(ksu_manual_su_pending);
+
+// uids with a pending root grant, looked up under RCU from the clone hook
+// and changed under pending_lock. pending_key_lock orders flipping the
+// static key against adds, since disabling it has to wait for a worker.
+static DEFINE_HASHTABLE(pending_uids, 4);
+static DEFINE_SPINLOCK(pending_lock);
 static int pending_cnt = 0;
+static DEFINE_MUTEX(pending_key_lock);
+
+static void pending_key_update(struct work_struct *work);
+static DECLARE_WORK(pending_key_work, pending_key_update);
+
 static struct ksu_token_entry auth_tokens[MAX_TOKENS] = { 0 };
 static int token_count = 0;
 static DEFINE_SPINLOCK(token_lock);
@@ -303,61 +320,140 @@ static bool is_current_verified(void)
     return current_verified;
 }
 
-bool is_pending_root(uid_t uid)
+// Caller holds rcu_read_lock or pending_lock
+static struct pending_uid *find_pending_root(uid_t uid)
 {
-    for (int i = 0; i < pending_cnt; i++) {
-        if (pending_uids[i].uid == uid) {
-            pending_uids[i].use_count++;
-            pending_uids[i].remove_calls++;
-            return true;
-        }
+    struct pending_uid *p;
+
+    hash_for_each_possible_rcu (pending_uids, p, node, uid) {
+        if (p->uid == uid)
+            return p;
     }
-    return false;
+    return NULL;
 }
 
-void remove_pending_root(uid_t uid)
+// Turns the static key off once the set is empty; runs from a worker since
+// the last removal happens in the clone hook, where it can't sleep.
+static void pending_key_update(struct work_struct *work)
 {
-    for (int i = 0; i < pending_cnt; i++) {
-        if (pending_uids[i].uid == uid) {
-            pending_uids[i].remove_calls++;
-
-            if (pending_uids[i].remove_calls >= REMOVE_DELAY_CALLS) {
-                pending_uids[i] = pending_uids[--pending_cnt];
-                pr_info("pending_root: removed UID %d after %d calls\n", uid,
-                        REMOVE_DELAY_CALLS);
-                ksu_temp_revoke_root_once(uid);
-            } else {
-                pr_info("pending_root: UID %d remove_call=%d (<%d)\n", uid,
-                        pending_uids[i].remove_calls, REMOVE_DELAY_CALLS);
-            }
-            return;
-        }
+    bool empty;
+
+    mutex_lock(&pending_key_lock);
+    spin_lock(&pending_lock);
+    empty = !pending_cnt;
+    spin_unlock(&pending_lock);
+    if (empty)
+        static_branch_disable(&ksu_manual_su_pending);
+    mutex_unlock(&pending_key_lock);
+}
+
+static void remove_pending_root(uid_t uid)
+{
+    struct pending_uid *p;
+    bool empty;
+
+    spin_lock(&pending_lock);
+    p = find_pending_root(uid);
+    // someone else removed it, or it was added again in the meantime
+    if (!p || atomic_read(&p->remove_calls) < REMOVE_DELAY_CALLS) {
+        spin_unlock(&pending_lock);
+        return;
     }
+    hash_del_rcu(&p->node);
+    empty = !--pending_cnt;
+    spin_unlock(&pending_lock);
+
+    kfree_rcu(p, rcu);
+    if (empty)
+        schedule_work(&pending_key_work);
+
+    pr_info("pending_root: removed UID %d after %d calls\n", uid,
+            REMOVE_DELAY_CALLS);
+    ksu_temp_revoke_root_once(uid);
 }
 
 static void add_pending_root(uid_t uid)
 {
-    if (pending_cnt >= MAX_PENDING) {
-        pr_warn("pending_root: cache full\n");
+    struct pending_uid *p, *new;
+    bool added = false;
+
+    new = kzalloc(sizeof(*new), GFP_KERNEL);
+    if (!new) {
+        pr_err("pending_root: alloc failed\n");
         return;
     }
-    for (int i = 0; i < pending_cnt; i++) {
-        if (pending_uids[i].uid == uid) {
-            pending_uids[i].use_count = 0;
-            pending_uids[i].remove_calls = 0;
-            return;
-        }
+    new->uid = uid;
+
+    mutex_lock(&pending_key_lock);
+    spin_lock(&pending_lock);
+    p = find_pending_root(uid);
+    if (p) {
+        atomic_set(&p->use_count, 0);
+        atomic_set(&p->remove_calls, 0);
+    } else if (pending_cnt < MAX_PENDING) {
+        hash_add_rcu(pending_uids, &new->node, uid);
+        pending_cnt++;
+        added = true;
+    }
+    spin_unlock(&pending_lock);
+    if (added)
+        static_branch_enable(&ksu_manual_su_pending);
+    mutex_unlock(&pending_key_lock);
+
+    if (!added) {
+        if (!p)
+            pr_warn("pending_root: cache full\n");
+        kfree(new);
+        return;
     }
-    pending_uids[pending_cnt++] = (struct pending_uid){ uid, 0 };
+
     ksu_temp_grant_root_once(uid);
     pr_info("pending_root: cached UID %d\n", uid);
 }
 
 void ksu_try_escalate_for_uid(uid_t uid)
 {
-    if (!is_pending_root(uid))
+    struct pending_uid *p;
+    int calls;
+
+    if (!ksu_manual_su_has_pending())
+        return;
+
+    rcu_read_lock();
+    p = find_pending_root(uid);
+    if (!p) {
+        rcu_read_unlock();
         return;
+    }
+    atomic_inc(&p->use_count);
+    // one clone used to count twice, in the lookup and in the removal
+    calls = atomic_add_return(2, &p->remove_calls);
+    rcu_read_unlock();
+
+    pr_debug("pending_root: UID=%d temporarily allowed, remove_calls=%d\n",
+             uid, calls);
+    if (calls >= REMOVE_DELAY_CALLS)
+        remove_pending_root(uid);
+}
+
+void ksu_manual_su_exit(void)
+{
+    struct pending_uid *p;
+    struct hlist_node *tmp;
+    int bkt;
+
+    cancel_work_sync(&pending_key_work);
+
+    spin_lock(&pending_lock);
+    hash_for_each_safe (pending_uids, bkt, tmp, p, node) {
+        hash_del_rcu(&p->node);
+        kfree_rcu(p, rcu);
+    }
+    pending_cnt = 0;
+    spin_unlock(&pending_lock);
 
-    pr_info("pending_root: UID=%d temporarily allowed\n", uid);
-    remove_pending_root(uid);
+    if (static_key_enabled(&ksu_manual_su_pending))
+        static_branch_disable(&ksu_manual_su_pending);
+    // wait for the kfree_rcu above before the module text goes away
+    rcu_barrier();
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define __KSU_MANUAL_SU_H
 
 #include <linux/types.h>
+#include <linux/jump_label.h>
 #include <linux/sched.h>
 #include <linux/version.h>
 
@@ -25,9 +26,11 @@
 #define MANUAL_SU_OP_ADD_PENDING 2
 
 struct pending_uid {
+    struct hlist_node node;
+    struct rcu_head rcu;
     uid_t uid;
-    int use_count;
-    int remove_calls;
+    atomic_t use_count;
+    atomic_t remove_calls;
 };
 
 struct manual_su_request {
@@ -42,8 +45,15 @@ struct ksu_token_entry {
     bool used;
 };
 
+// On while some uid has a pending root grant
+DECLARE_STATIC_KEY_FALSE(ksu_manual_su_pending);
+
+static inline bool ksu_manual_su_has_pending(void)
+{
+    return static_branch_unlikely(&ksu_manual_su_pending);
+}
+
 int ksu_handle_manual_su_request(int option, struct manual_su_request *request);
-bool is_pending_root(uid_t uid);
-void remove_pending_root(uid_t uid);
 void ksu_try_escalate_for_uid(uid_t uid);
+void ksu_manual_su_exit(void);
 #endif
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include <linux/fs.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/version.h>
+
+#include "status_page.h"
+#include "klog.h" // IWYU pragma: keep
+#include "ksu.h"
+#include "manager.h"
+#include "syscall_hook_manager.h"
+
+static struct ksu_status_page *status_page;
+static DEFINE_SPINLOCK(status_lock);
+
+static void status_write_begin(void)
+{
+    spin_lock(&status_lock);
+    WRITE_ONCE(status_page->seq, status_page->seq + 1);
+    smp_wmb();
+}
+
+static void status_write_end(void)
+{
+    smp_store_release(&status_page->seq, status_page->seq + 1);
+    spin_unlock(&status_lock);
+}
+
+void ksu_status_set_manager_appid(uid_t appid)
+{
+    if (!status_page)
+        return;
+
+    status_write_begin();
+    status_page->manager_appid = appid;
+    status_write_end();
+}
+
+void ksu_status_set_safe_mode(bool safe_mode)
+{
+    if (!status_page)
+        return;
+
+    status_write_begin();
+    status_page->safe_mode = safe_mode;
+    status_write_end();
+}
+
+void ksu_status_set_feature(u32 feature_id, bool supported, u64 value)
+{
+    if (!status_page || feature_id >= KSU_FEATURE_MAX)
+        return;
+
+    status_write_begin();
+    if (supported)
+        status_page->feature_supported[feature_id / 64] |=
+            1ULL << (feature_id % 64);
+    else
+        status_page->feature_supported[feature_id / 64] &=
+            ~(1ULL << (feature_id % 64));
+    status_page->feature_values[feature_id] = value;
+    status_write_end();
+}
+
+int ksu_status_page_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    if (!status_page)
+        return -ENODEV;
+
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+        return -EINVAL;
+
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+    return remap_pfn_range(vma, vma->vm_start,
+                           virt_to_phys(status_page) >> PAGE_SHIFT, PAGE_SIZE,
+                           vma->vm_page_prot);
+}
+
+int ksu_status_page_init(void)
+{
+    BUILD_BUG_ON(sizeof(struct ksu_status_page) > PAGE_SIZE);
+
+    status_page = (struct ksu_status_page *)get_zeroed_page(GFP_KERNEL);
+    if (!status_page) {
+        pr_err("status_page: alloc failed\n");
+        return -ENOMEM;
+    }
+
+    status_page->magic = KSU_STATUS_MAGIC;
+    status_page->version = KSU_STATUS_VERSION;
+    status_page->kernel_version = KERNEL_SU_VERSION;
+#ifdef MODULE
+    status_page->flags |= 0x1;
+#endif
+    status_page->max_feature = KSU_FEATURE_MAX;
+    status_page->manager_appid = ksu_get_manager_appid();
+    status_page->kpm_enabled = IS_ENABLED(CONFIG_KPM);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 13, 0)
+    strscpy(status_page->hook_type, KSU_HOOK_TYPE,
+            sizeof(status_page->hook_type));
+#else
+    strlcpy(status_page->hook_type, KSU_HOOK_TYPE,
+            sizeof(status_page->hook_type));
+#endif
+
+    return 0;
+}
+
+void ksu_status_page_exit(void)
+{
+    // the ksu fd pins the module, so nothing can still map the page
+    if (status_page) {
+        free_page((unsigned long)status_page);
+        status_page = NULL;
+    }
+}
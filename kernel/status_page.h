@@ -0,0 +1,49 @@
+#ifndef __KSU_H_STATUS_PAGE
+#define __KSU_H_STATUS_PAGE
+
+#include <linux/types.h>
+#include <linux/mm_types.h>
+#include "feature.h"
+
+#define KSU_STATUS_MAGIC 0x5453534b // "KSST"
+#define KSU_STATUS_VERSION 1
+
+// Read-only page userspace gets by mmap'ing the [ksu_driver] fd (one page,
+// offset 0). Readers take a consistent snapshot like a seqcount:
+//
+//   do {
+//       seq = load_acquire(&page->seq);
+//       if (seq & 1) continue;
+//       copy what is needed;
+//   } while (load_acquire(&page->seq) != seq);
+//
+// Per-caller state, like the "is manager" bit of GET_INFO, is not here.
+// feature_supported always starts at offset 64; its length and the offset of
+// feature_values follow from max_feature, so old readers keep working when
+// features are added.
+struct ksu_status_page {
+    __u32 magic;
+    __u32 version; // layout version, KSU_STATUS_VERSION
+    __u32 seq; // odd while an update is in progress
+    __u32 kernel_version; // KERNEL_SU_VERSION
+    __u32 flags; // bit 0: MODULE mode
+    __u32 max_feature; // KSU_FEATURE_MAX
+    __s32 manager_appid; // -1 if no manager
+    __u8 safe_mode;
+    __u8 kpm_enabled;
+    __u8 reserved[2];
+    char hook_type[32];
+    __u64 feature_supported[(KSU_FEATURE_MAX + 63) / 64]; // bitmap
+    __u64 feature_values[KSU_FEATURE_MAX];
+};
+
+int ksu_status_page_init(void);
+void ksu_status_page_exit(void);
+
+int ksu_status_page_mmap(struct file *filp, struct vm_area_struct *vma);
+
+void ksu_status_set_manager_appid(uid_t appid);
+void ksu_status_set_safe_mode(bool safe_mode);
+void ksu_status_set_feature(u32 feature_id, bool supported, u64 value);
+
+#endif // __KSU_H_STATUS_PAGE
@@ -136,19 +136,9 @@ int ksu_handle_execve_sucompat(const char __user **filename_user,
     if (unlikely(!filename_user))
         return 0;
 
-#if __SULOG_GATE
-    bool is_allowed = ksu_is_allow_uid_for_current(current_uid().val);
-    ksu_sulog_report_syscall(current_uid().val, NULL, "execve", path);
-
-    if (!is_allowed)
-        return 0;
-
-    ksu_sulog_report_su_attempt(current_uid().val, NULL, path, is_allowed);
-#else
     if (!ksu_is_allow_uid_for_current(current_uid().val)) {
         return 0;
     }
-#endif
 
     addr = untagged_addr((unsigned long)*filename_user);
     fn = (const char __user *)addr;
@@ -177,6 +167,9 @@ int ksu_handle_execve_sucompat(const char __user **filename_user,
         return 0;
 
     pr_info("sys_execve su found\n");
+#if __SULOG_GATE
+    ksu_sulog_report_su_attempt(current_uid().val, NULL, su, true);
+#endif
     *filename_user = ksud_user_path();
 
     escape_with_root_profile();
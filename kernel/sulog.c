@@ -3,7 +3,6 @@
 #include <linux/printk.h>
 #include <linux/slab.h>
 #include <linux/string.h>
-#include <linux/task_work.h>
 #include <linux/time.h>
 #include <linux/types.h>
 #include <linux/uaccess.h>
@@ -13,6 +12,16 @@
 #include <linux/mm.h>
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/jhash.h>
+#include <linux/timekeeping.h>
+#include <linux/anon_inodes.h>
+#include <linux/file.h>
+#include <linux/poll.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/version.h>
 
 #include "klog.h"
 
@@ -22,11 +31,22 @@
 
 #if __SULOG_GATE
 
-struct dedup_entry dedup_tbl[SULOG_COMM_LEN];
-static DEFINE_SPINLOCK(dedup_lock);
-static LIST_HEAD(sulog_queue);
+static struct dedup_entry dedup_tbl[SULOG_DEDUP_SETS][SULOG_DEDUP_WAYS];
+static DEFINE_MUTEX(sulog_consume_lock);
+static struct sulog_cpu_ring __percpu *sulog_rings __read_mostly;
 static bool sulog_enabled __read_mostly = true;
 
+// Events handed to userspace. The buffer is one header page followed by
+// SULOG_USER_ENTRIES fixed-size entries and can be mmap'ed read-only by
+// the reader; only the drain work writes to it.
+static void *sulog_buf;
+static struct ksu_sulog_header *sulog_hdr;
+static struct ksu_sulog_entry *sulog_entries;
+static DECLARE_WAIT_QUEUE_HEAD(sulog_wq);
+
+static void sulog_expire_work_func(struct work_struct *work);
+static DECLARE_DELAYED_WORK(sulog_expire_work, sulog_expire_work_func);
+
 static int sulog_feature_get(u64 *value)
 {
     *value = sulog_enabled ? 1 : 0;
@@ -48,41 +68,33 @@ static const struct ksu_feature_handler sulog_handler = {
     .set_handler = sulog_feature_set,
 };
 
-static void get_timestamp(char *buf, size_t len)
+// Resolve the full command line of the reporting task. This runs on the
+// consumer side, so the task may already be gone or its pid reused; fall
+// back to the comm captured at report time in both cases.
+static void ksu_get_cmdline(char *full_comm, const struct sulog_event *evt,
+                            size_t buf_len)
 {
-    struct timespec64 ts;
-    struct tm tm;
-
-    ktime_get_real_ts64(&ts);
-    time64_to_tm(ts.tv_sec - sys_tz.tz_minuteswest * 60, 0, &tm);
-
-    snprintf(buf, len, "%04ld-%02d-%02d %02d:%02d:%02d", tm.tm_year + 1900,
-             tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
-}
+    struct task_struct *tsk;
+    int n = 0;
 
-static void ksu_get_cmdline(char *full_comm, const char *comm, size_t buf_len)
-{
     if (!full_comm || buf_len <= 0)
         return;
 
-    if (comm && strlen(comm) > 0) {
-        KSU_STRSCPY(full_comm, comm, buf_len);
-        return;
-    }
+    KSU_STRSCPY(full_comm, evt->comm, buf_len);
 
-    if (in_atomic() || in_interrupt() || irqs_disabled()) {
-        KSU_STRSCPY(full_comm, current->comm, buf_len);
+    if (!evt->pid)
         return;
-    }
 
-    if (!current->mm) {
-        KSU_STRSCPY(full_comm, current->comm, buf_len);
+    tsk = get_pid_task(find_vpid(evt->pid), PIDTYPE_PID);
+    if (!tsk)
         return;
-    }
 
-    int n = get_cmdline(current, full_comm, buf_len);
+    if (tsk->mm && !strncmp(tsk->comm, evt->comm, TASK_COMM_LEN))
+        n = get_cmdline(tsk, full_comm, buf_len);
+    put_task_struct(tsk);
+
     if (n <= 0) {
-        KSU_STRSCPY(full_comm, current->comm, buf_len);
+        KSU_STRSCPY(full_comm, evt->comm, buf_len);
         return;
     }
 
@@ -120,255 +132,500 @@ static void sanitize_string(char *str, size_t len)
     str[write_pos] = '\0';
 }
 
-static bool dedup_should_print(uid_t uid, u8 type, const char *content,
-                               size_t len)
+static void sulog_arena_read(struct sulog_cpu_ring *ring, u32 off, char *dst,
+                             size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        dst[i] = ring->arena[(off + i) & (SULOG_ARENA_SIZE - 1)];
+}
+
+static void sulog_arena_write(struct sulog_cpu_ring *ring, u32 off,
+                              const char *src, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        ring->arena[(off + i) & (SULOG_ARENA_SIZE - 1)] = src[i];
+}
+
+// Pop one record from the ring and decode it. Must only be called by the
+// single consumer.
+static bool sulog_ring_pop(struct sulog_cpu_ring *ring,
+                           struct sulog_event *evt)
 {
-    struct dedup_key key = {
-        .crc = dedup_calc_hash(content, len),
-        .uid = uid,
-        .type = type,
-    };
-    u64 now = ktime_get_ns();
-    u64 delta_ns = DEDUP_SECS * NSEC_PER_SEC;
-
-    u32 idx = key.crc & (SULOG_COMM_LEN - 1);
-    spin_lock(&dedup_lock);
-
-    struct dedup_entry *e = &dedup_tbl[idx];
-    if (e->key.crc == key.crc && e->key.uid == key.uid &&
-        e->key.type == key.type && (now - e->ts_ns) < delta_ns) {
-        spin_unlock(&dedup_lock);
+    struct sulog_record *rec;
+    char strs[TASK_COMM_LEN + SULOG_ARGS_LEN];
+    u32 tail = ring->tail;
+    size_t comm_len;
+
+    if (tail == smp_load_acquire(&ring->head))
         return false;
-    }
 
-    e->key = key;
-    e->ts_ns = now;
-    spin_unlock(&dedup_lock);
+    rec = &ring->recs[tail & (SULOG_RING_RECORDS - 1)];
+
+    evt->ts_ns = rec->ts_ns;
+    evt->uid = rec->uid;
+    evt->target_uid = rec->target_uid;
+    evt->pid = rec->pid;
+    evt->comm_hash = rec->comm_hash;
+    evt->type = rec->type;
+    evt->result = rec->result;
+    evt->name = rec->name;
+
+    sulog_arena_read(ring, rec->args_off, strs,
+                     min_t(size_t, rec->args_len, sizeof(strs)));
+    strs[sizeof(strs) - 1] = '\0';
+    KSU_STRSCPY(evt->comm, strs, sizeof(evt->comm));
+    comm_len = strnlen(strs, sizeof(strs) - 1) + 1;
+    if (comm_len < rec->args_len)
+        KSU_STRSCPY(evt->args, strs + comm_len, sizeof(evt->args));
+    else
+        evt->args[0] = '\0';
+
+    smp_store_release(&ring->arena_tail, rec->args_off + rec->args_len);
+    smp_store_release(&ring->tail, tail + 1);
     return true;
 }
 
-static void sulog_process_queue(void)
+static void sulog_push_entry(const struct ksu_sulog_entry *entry)
+{
+    u64 head = sulog_hdr->head;
+
+    // readers must see head move past the old entry before its slot changes
+    smp_wmb();
+    memcpy(&sulog_entries[head & (SULOG_USER_ENTRIES - 1)], entry,
+           sizeof(*entry));
+    smp_store_release(&sulog_hdr->head, head + 1);
+}
+
+static void sulog_fill_entry(struct ksu_sulog_entry *entry,
+                             const struct sulog_event *evt)
+{
+    memset(entry, 0, sizeof(*entry));
+    entry->ts_ns = evt->ts_ns;
+    entry->uid = evt->uid;
+    entry->target_uid = evt->target_uid;
+    entry->pid = evt->pid;
+    entry->count = 1;
+    entry->type = evt->type;
+    entry->result = evt->result;
+    if (evt->name)
+        KSU_STRSCPY(entry->name, evt->name, sizeof(entry->name));
+    KSU_STRSCPY(entry->args, evt->args, sizeof(entry->args));
+    ksu_get_cmdline(entry->comm, evt, sizeof(entry->comm));
+    sanitize_string(entry->comm, sizeof(entry->comm));
+}
+
+static void dedup_emit_summary(struct dedup_entry *e)
 {
-    struct file *fp;
-    struct sulog_entry *entry, *tmp;
-    LIST_HEAD(local_queue);
-    loff_t pos = 0;
-    unsigned long flags;
-    const struct cred *old_cred;
-
-    spin_lock_irqsave(&dedup_lock, flags);
-    list_splice_init(&sulog_queue, &local_queue);
-    spin_unlock_irqrestore(&dedup_lock, flags);
-
-    if (list_empty(&local_queue))
+    struct ksu_sulog_entry entry;
+
+    if (!e->hits)
         return;
 
-    old_cred = override_creds(ksu_cred);
+    sulog_fill_entry(&entry, &e->evt);
+    entry.ts_ns = e->last_ns;
+    entry.count = e->hits;
+    entry.flags = KSU_SULOG_F_REPEAT;
+    sulog_push_entry(&entry);
+    e->hits = 0;
+}
+
+static u32 dedup_calc_crc(const struct sulog_event *evt)
+{
+    u32 crc;
+
+    // the key covers what the formatted line would say, minus time and pid
+    crc = dedup_calc_hash((const char *)&evt->comm_hash,
+                          sizeof(evt->comm_hash));
+    crc = crc32(crc, evt->args, strnlen(evt->args, SULOG_ARGS_LEN));
+    if (evt->name)
+        crc = crc32(crc, evt->name, strlen(evt->name));
+    crc = crc32(crc, &evt->result, sizeof(evt->result));
+    crc = crc32(crc, &evt->target_uid, sizeof(evt->target_uid));
+    return crc;
+}
+
+// Returns false if evt repeats an entry still inside its DEDUP_SECS window;
+// the repeat is then only counted. A set is searched for (uid, type, crc),
+// otherwise its least recently seen way is replaced, and a victim that
+// swallowed repeats reports them first.
+static bool dedup_should_print(const struct sulog_event *evt)
+{
+    struct dedup_entry *set, *victim = NULL;
+    u64 window_ns = DEDUP_SECS * NSEC_PER_SEC;
+    u32 crc = dedup_calc_crc(evt);
+    int i;
+
+    set = dedup_tbl[jhash_3words(crc, evt->uid, evt->type, 0) &
+                    (SULOG_DEDUP_SETS - 1)];
+
+    for (i = 0; i < SULOG_DEDUP_WAYS; i++) {
+        struct dedup_entry *e = &set[i];
+
+        if (e->last_ns && e->crc == crc && e->evt.uid == evt->uid &&
+            e->evt.type == evt->type) {
+            if (evt->ts_ns - e->evt.ts_ns < window_ns) {
+                if (!e->hits++)
+                    schedule_delayed_work(&sulog_expire_work,
+                                          DEDUP_SECS * HZ);
+                e->last_ns = evt->ts_ns;
+                return false;
+            }
+            victim = e;
+            break;
+        }
 
-    fp = filp_open(SULOG_PATH, O_WRONLY | O_CREAT | O_APPEND, 0640);
-    if (IS_ERR(fp)) {
-        pr_err("sulog: failed to open log file: %ld\n", PTR_ERR(fp));
-        goto revert_creds_out;
+        if (!victim || e->last_ns < victim->last_ns)
+            victim = e;
     }
 
-    if (fp->f_inode->i_size > SULOG_MAX_SIZE) {
-        if (vfs_truncate(&fp->f_path, 0))
-            pr_err("sulog: failed to truncate log file\n");
-        pos = 0;
-    } else {
-        pos = fp->f_inode->i_size;
+    dedup_emit_summary(victim);
+    victim->evt = *evt;
+    victim->crc = crc;
+    victim->last_ns = evt->ts_ns;
+    return true;
+}
+
+// Report the repeats of every entry whose window has closed. Returns true if
+// some entry is still collecting repeats.
+static bool dedup_expire(u64 now_ns)
+{
+    u64 window_ns = DEDUP_SECS * NSEC_PER_SEC;
+    bool pending = false;
+    int i, j;
+
+    for (i = 0; i < SULOG_DEDUP_SETS; i++) {
+        for (j = 0; j < SULOG_DEDUP_WAYS; j++) {
+            struct dedup_entry *e = &dedup_tbl[i][j];
+
+            if (!e->hits)
+                continue;
+            if (now_ns - e->evt.ts_ns >= window_ns)
+                dedup_emit_summary(e);
+            else
+                pending = true;
+        }
     }
 
-    list_for_each_entry (entry, &local_queue, list)
-        kernel_write(fp, entry->content, strlen(entry->content), &pos);
+    return pending;
+}
+
+static void sulog_drain(void)
+{
+    struct ksu_sulog_entry entry;
+    struct sulog_event evt;
+    u64 head;
+    int cpu;
+
+    mutex_lock(&sulog_consume_lock);
+
+    if (!sulog_rings)
+        goto unlock;
+
+    head = sulog_hdr->head;
 
-    vfs_fsync(fp, 0);
-    filp_close(fp, 0);
+    if (dedup_expire(ktime_get_real_ns()))
+        schedule_delayed_work(&sulog_expire_work, DEDUP_SECS * HZ);
 
-revert_creds_out:
-    revert_creds(old_cred);
+    for_each_possible_cpu (cpu) {
+        struct sulog_cpu_ring *ring = per_cpu_ptr(sulog_rings, cpu);
+        u32 dropped;
 
-    list_for_each_entry_safe (entry, tmp, &local_queue, list) {
-        list_del(&entry->list);
-        kfree(entry);
+        while (sulog_ring_pop(ring, &evt)) {
+            if (!dedup_should_print(&evt))
+                continue;
+            sulog_fill_entry(&entry, &evt);
+            sulog_push_entry(&entry);
+        }
+
+        dropped = READ_ONCE(ring->dropped);
+        if (dropped != ring->dropped_reported) {
+            memset(&entry, 0, sizeof(entry));
+            entry.ts_ns = ktime_get_real_ns();
+            entry.type = SULOG_EVT_DROPPED;
+            entry.count = dropped - ring->dropped_reported;
+            sulog_push_entry(&entry);
+            ring->dropped_reported = dropped;
+        }
     }
+
+    if (sulog_hdr->head != head)
+        wake_up_interruptible(&sulog_wq);
+
+unlock:
+    mutex_unlock(&sulog_consume_lock);
 }
 
-static void sulog_task_work_handler(struct callback_head *work)
+static void sulog_drain_work_func(struct work_struct *work)
 {
-    sulog_process_queue();
-    kfree(work);
+    sulog_drain();
 }
 
-static void sulog_schedule_task_work(void)
+static void sulog_expire_work_func(struct work_struct *work)
 {
-    struct task_struct *tsk;
-    struct callback_head *cb;
+    sulog_drain();
+}
+
+static DECLARE_WORK(sulog_drain_work, sulog_drain_work_func);
+
+// Readers never take a lock: copy the slot, then re-check that the writer
+// hasn't lapped it in the meantime. Returns false if the entry was lost.
+static bool sulog_copy_entry(u64 seq, struct ksu_sulog_entry *entry)
+{
+    memcpy(entry, &sulog_entries[seq & (SULOG_USER_ENTRIES - 1)],
+           sizeof(*entry));
+    smp_rmb();
+    return READ_ONCE(sulog_hdr->head) - seq < SULOG_USER_ENTRIES;
+}
+
+// The oldest entry sulog_copy_entry() still accepts for this head
+static u64 sulog_oldest_seq(u64 head)
+{
+    return head >= SULOG_USER_ENTRIES ? head - (SULOG_USER_ENTRIES - 1) : 0;
+}
+
+static ssize_t sulog_fd_read(struct file *filp, char __user *buf, size_t count,
+                             loff_t *ppos)
+{
+    struct ksu_sulog_entry entry;
+    u64 seq = *ppos;
+    u64 head;
+    size_t copied = 0;
     int ret;
 
-    tsk = get_pid_task(find_vpid(1), PIDTYPE_PID);
-    if (!tsk) {
-        pr_err("sulog: failed to find init task\n");
-        return;
+    if (count < sizeof(entry))
+        return -EINVAL;
+
+    head = smp_load_acquire(&sulog_hdr->head);
+    while (seq == head) {
+        if (filp->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(
+            sulog_wq, smp_load_acquire(&sulog_hdr->head) != seq);
+        if (ret)
+            return ret;
+        head = smp_load_acquire(&sulog_hdr->head);
     }
 
-    cb = kzalloc(sizeof(*cb), GFP_ATOMIC);
-    if (!cb) {
-        pr_err("sulog: failed to allocate task_work callback\n");
-        goto put_task;
+    while (copied + sizeof(entry) <= count && seq != head) {
+        if (head - seq >= SULOG_USER_ENTRIES)
+            seq = sulog_oldest_seq(head);
+        if (!sulog_copy_entry(seq, &entry)) {
+            // lapped by the writer, skip to what is still there
+            head = smp_load_acquire(&sulog_hdr->head);
+            continue;
+        }
+        if (copy_to_user(buf + copied, &entry, sizeof(entry)))
+            return copied ? copied : -EFAULT;
+        copied += sizeof(entry);
+        seq++;
     }
 
-    cb->func = sulog_task_work_handler;
+    *ppos = seq;
+    return copied;
+}
 
-    ret = task_work_add(tsk, cb, TWA_RESUME);
-    if (ret) {
-        pr_err("sulog: failed to queue task work: %d\n", ret);
-        kfree(cb);
-    }
+static __poll_t sulog_fd_poll(struct file *filp, poll_table *wait)
+{
+    poll_wait(filp, &sulog_wq, wait);
 
-put_task:
-    put_task_struct(tsk);
+    if (smp_load_acquire(&sulog_hdr->head) != (u64)filp->f_pos)
+        return EPOLLIN | EPOLLRDNORM;
+    return 0;
 }
 
-static void sulog_add_entry(char *log_buf, size_t len, uid_t uid, u8 dedup_type)
+static int sulog_fd_mmap(struct file *filp, struct vm_area_struct *vma)
 {
-    struct sulog_entry *entry;
-    unsigned long flags;
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
 
-    if (!sulog_enabled || !log_buf || len == 0)
-        return;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
 
-    if (!dedup_should_print(uid, dedup_type, log_buf, len))
-        return;
+    return remap_vmalloc_range(vma, sulog_buf, vma->vm_pgoff);
+}
 
-    entry = kzalloc(sizeof(*entry), GFP_ATOMIC);
-    if (!entry)
-        return;
+static const struct file_operations sulog_fops = {
+    .owner = THIS_MODULE,
+    .read = sulog_fd_read,
+    .poll = sulog_fd_poll,
+    .mmap = sulog_fd_mmap,
+    .llseek = noop_llseek,
+};
+
+int ksu_sulog_install_fd(unsigned int flags)
+{
+    struct file *filp;
+    int fd;
+
+    if (!sulog_buf)
+        return -ENODEV;
 
-    KSU_STRSCPY(entry->content, log_buf, SULOG_ENTRY_MAX_LEN);
+    fd = get_unused_fd_flags(O_CLOEXEC);
+    if (fd < 0)
+        return fd;
+
+    filp = anon_inode_getfile("[ksu_sulog]", &sulog_fops, NULL,
+                              O_RDONLY | (flags & O_NONBLOCK));
+    if (IS_ERR(filp)) {
+        put_unused_fd(fd);
+        return PTR_ERR(filp);
+    }
 
-    spin_lock_irqsave(&dedup_lock, flags);
-    list_add_tail(&entry->list, &sulog_queue);
-    spin_unlock_irqrestore(&dedup_lock, flags);
+    // start at the oldest event still buffered, so what happened before
+    // the reader showed up is not lost
+    filp->f_pos = sulog_oldest_seq(smp_load_acquire(&sulog_hdr->head));
 
-    sulog_schedule_task_work();
+    fd_install(fd, filp);
+    return fd;
 }
 
-void ksu_sulog_report_su_grant(uid_t uid, const char *comm, const char *method)
+static void sulog_add_event(u8 type, uid_t uid, const char *comm,
+                            const char *name, const char *args, u8 result,
+                            uid_t target_uid)
 {
-    char log_buf[SULOG_ENTRY_MAX_LEN];
-    char timestamp[32];
-    char full_comm[SULOG_COMM_LEN];
-
-    if (!sulog_enabled)
+    struct sulog_cpu_ring __percpu *rings;
+    struct sulog_cpu_ring *ring;
+    struct sulog_record *rec;
+    const char *src_comm = comm ? comm : current->comm;
+    size_t comm_len = strnlen(src_comm, TASK_COMM_LEN - 1);
+    size_t args_len = args ? strnlen(args, SULOG_ARGS_LEN - 1) : 0;
+    size_t need = comm_len + 1 + args_len + 1;
+    u32 head, arena_head;
+
+    // the producer side is preempt-disabled, which keeps the rings alive
+    // against ksu_sulog_exit and owns this cpu's head exclusively; the drain
+    // work is only queued from inside that section
+    preempt_disable();
+    rings = READ_ONCE(sulog_rings);
+    if (unlikely(!rings)) {
+        preempt_enable();
         return;
+    }
+    ring = this_cpu_ptr(rings);
+
+    head = ring->head;
+    arena_head = ring->arena_head;
+    if (head - smp_load_acquire(&ring->tail) >= SULOG_RING_RECORDS ||
+        SULOG_ARENA_SIZE - (arena_head - smp_load_acquire(&ring->arena_tail)) <
+            need) {
+        WRITE_ONCE(ring->dropped, ring->dropped + 1);
+        schedule_work(&sulog_drain_work);
+        preempt_enable();
+        return;
+    }
 
-    get_timestamp(timestamp, sizeof(timestamp));
-    ksu_get_cmdline(full_comm, comm, sizeof(full_comm));
-
-    sanitize_string(full_comm, sizeof(full_comm));
+    sulog_arena_write(ring, arena_head, src_comm, comm_len);
+    sulog_arena_write(ring, arena_head + comm_len, "", 1);
+    if (args_len)
+        sulog_arena_write(ring, arena_head + comm_len + 1, args, args_len);
+    sulog_arena_write(ring, arena_head + comm_len + 1 + args_len, "", 1);
+
+    rec = &ring->recs[head & (SULOG_RING_RECORDS - 1)];
+    rec->ts_ns = ktime_get_real_ns();
+    rec->name = name;
+    rec->uid = uid;
+    rec->target_uid = target_uid;
+    rec->pid = current->pid;
+    rec->comm_hash = jhash(src_comm, comm_len, 0);
+    rec->args_off = arena_head;
+    rec->args_len = need;
+    rec->type = type;
+    rec->result = result;
+
+    ring->arena_head = arena_head + need;
+    smp_store_release(&ring->head, head + 1);
+
+    // still inside the section: ksu_sulog_exit() waits for us before it
+    // cancels the work, so it can't be queued after that
+    schedule_work(&sulog_drain_work);
+
+    preempt_enable();
+}
 
-    snprintf(log_buf, sizeof(log_buf),
-             "[%s] SU_GRANT: UID=%d COMM=%s METHOD=%s PID=%d\n", timestamp, uid,
-             full_comm, method ? method : "unknown", current->pid);
+void ksu_sulog_report_su_grant(uid_t uid, const char *comm, const char *method)
+{
+    if (!sulog_enabled)
+        return;
 
-    sulog_add_entry(log_buf, strlen(log_buf), uid, DEDUP_SU_GRANT);
+    sulog_add_event(SULOG_EVT_SU_GRANT, uid, comm, method, NULL, 0, 0);
 }
 
 void ksu_sulog_report_su_attempt(uid_t uid, const char *comm,
                                  const char *target_path, bool success)
 {
-    char log_buf[SULOG_ENTRY_MAX_LEN];
-    char timestamp[32];
-    char full_comm[SULOG_COMM_LEN];
-
     if (!sulog_enabled)
         return;
 
-    get_timestamp(timestamp, sizeof(timestamp));
-    ksu_get_cmdline(full_comm, comm, sizeof(full_comm));
-
-    sanitize_string(full_comm, sizeof(full_comm));
-
-    snprintf(log_buf, sizeof(log_buf),
-             "[%s] SU_EXEC: UID=%d COMM=%s TARGET=%s RESULT=%s PID=%d\n",
-             timestamp, uid, full_comm, target_path ? target_path : "unknown",
-             success ? "SUCCESS" : "DENIED", current->pid);
-
-    sulog_add_entry(log_buf, strlen(log_buf), uid, DEDUP_SU_ATTEMPT);
+    sulog_add_event(SULOG_EVT_SU_ATTEMPT, uid, comm, NULL, target_path,
+                    success, 0);
 }
 
 void ksu_sulog_report_permission_check(uid_t uid, const char *comm,
                                        bool allowed)
 {
-    char log_buf[SULOG_ENTRY_MAX_LEN];
-    char timestamp[32];
-    char full_comm[SULOG_COMM_LEN];
-
     if (!sulog_enabled)
         return;
 
-    get_timestamp(timestamp, sizeof(timestamp));
-    ksu_get_cmdline(full_comm, comm, sizeof(full_comm));
-
-    sanitize_string(full_comm, sizeof(full_comm));
-
-    snprintf(log_buf, sizeof(log_buf),
-             "[%s] PERM_CHECK: UID=%d COMM=%s RESULT=%s PID=%d\n", timestamp,
-             uid, full_comm, allowed ? "ALLOWED" : "DENIED", current->pid);
-
-    sulog_add_entry(log_buf, strlen(log_buf), uid, DEDUP_PERM_CHECK);
+    sulog_add_event(SULOG_EVT_PERM_CHECK, uid, comm, NULL, NULL, allowed, 0);
 }
 
 void ksu_sulog_report_manager_operation(const char *operation,
                                         uid_t manager_uid, uid_t target_uid)
 {
-    char log_buf[SULOG_ENTRY_MAX_LEN];
-    char timestamp[32];
-    char full_comm[SULOG_COMM_LEN];
-
     if (!sulog_enabled)
         return;
 
-    get_timestamp(timestamp, sizeof(timestamp));
-    ksu_get_cmdline(full_comm, NULL, sizeof(full_comm));
-
-    sanitize_string(full_comm, sizeof(full_comm));
-
-    snprintf(
-        log_buf, sizeof(log_buf),
-        "[%s] MANAGER_OP: OP=%s MANAGER_UID=%d TARGET_UID=%d COMM=%s PID=%d\n",
-        timestamp, operation ? operation : "unknown", manager_uid, target_uid,
-        full_comm, current->pid);
-
-    sulog_add_entry(log_buf, strlen(log_buf), manager_uid, DEDUP_MANAGER_OP);
+    sulog_add_event(SULOG_EVT_MANAGER_OP, manager_uid, NULL, operation, NULL,
+                    0, target_uid);
 }
 
 void ksu_sulog_report_syscall(uid_t uid, const char *comm, const char *syscall,
                               const char *args)
 {
-    char log_buf[SULOG_ENTRY_MAX_LEN];
-    char timestamp[32];
-    char full_comm[SULOG_COMM_LEN];
-
     if (!sulog_enabled)
         return;
 
-    get_timestamp(timestamp, sizeof(timestamp));
-    ksu_get_cmdline(full_comm, comm, sizeof(full_comm));
-
-    sanitize_string(full_comm, sizeof(full_comm));
-
-    snprintf(log_buf, sizeof(log_buf),
-             "[%s] SYSCALL: UID=%d COMM=%s SYSCALL=%s ARGS=%s PID=%d\n",
-             timestamp, uid, full_comm, syscall ? syscall : "unknown",
-             args ? args : "none", current->pid);
-
-    sulog_add_entry(log_buf, strlen(log_buf), uid, DEDUP_SYSCALL);
+    sulog_add_event(SULOG_EVT_SYSCALL, uid, comm, syscall, args, 0, 0);
 }
 
 int ksu_sulog_init(void)
 {
+    struct sulog_cpu_ring __percpu *rings;
+    void *buf;
+
+    if (sulog_rings)
+        return 0;
+
+    buf = vmalloc_user(SULOG_USER_BUF_SIZE);
+    if (!buf) {
+        pr_err("sulog: failed to allocate user buffer\n");
+        return -ENOMEM;
+    }
+
+    rings = alloc_percpu(struct sulog_cpu_ring);
+    if (!rings) {
+        pr_err("sulog: failed to allocate event rings\n");
+        vfree(buf);
+        return -ENOMEM;
+    }
+
+    sulog_hdr = buf;
+    sulog_hdr->magic = KSU_SULOG_MAGIC;
+    sulog_hdr->version = KSU_SULOG_VERSION;
+    sulog_hdr->entry_size = sizeof(struct ksu_sulog_entry);
+    sulog_hdr->nr_entries = SULOG_USER_ENTRIES;
+    sulog_hdr->data_offset = PAGE_SIZE;
+    sulog_entries = buf + PAGE_SIZE;
+    smp_store_release(&sulog_buf, buf);
+    smp_store_release(&sulog_rings, rings);
+
     if (ksu_register_feature_handler(&sulog_handler)) {
         pr_err("Failed to register sulog feature handler\n");
     }
@@ -379,21 +636,35 @@ int ksu_sulog_init(void)
 
 void ksu_sulog_exit(void)
 {
-    struct sulog_entry *entry, *tmp;
-    unsigned long flags;
+    struct sulog_cpu_ring __percpu *rings;
 
     ksu_unregister_feature_handler(KSU_FEATURE_SULOG);
 
     sulog_enabled = false;
 
-    sulog_process_queue();
+    mutex_lock(&sulog_consume_lock);
+    rings = sulog_rings;
+    WRITE_ONCE(sulog_rings, NULL);
+    mutex_unlock(&sulog_consume_lock);
+
+    if (rings) {
+        // wait for producers that already picked up the old pointer; once
+        // they are gone nothing can queue the works again
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 20, 0)
+        synchronize_rcu();
+#else
+        synchronize_sched();
+#endif
+        cancel_work_sync(&sulog_drain_work);
+        cancel_delayed_work_sync(&sulog_expire_work);
+        free_percpu(rings);
+    }
 
-    spin_lock_irqsave(&dedup_lock, flags);
-    list_for_each_entry_safe (entry, tmp, &sulog_queue, list) {
-        list_del(&entry->list);
-        kfree(entry);
+    // the sulog fd pins the module, so no reader can be left at this point
+    if (sulog_buf) {
+        vfree(sulog_buf);
+        sulog_buf = NULL;
     }
-    spin_unlock_irqrestore(&dedup_lock, flags);
 
     pr_info("sulog: cleaned up successfully\n");
 }
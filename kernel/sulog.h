@@ -2,6 +2,8 @@
 #define __KSU_SULOG_H
 
 #include <linux/types.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
 #include <linux/version.h>
 #include <linux/crc32.h> // needed for function dedup_calc_hash
 
@@ -9,11 +11,6 @@
 
 #if __SULOG_GATE
 
-extern struct timezone sys_tz;
-
-#define SULOG_PATH "/data/adb/ksu/log/sulog.log"
-#define SULOG_MAX_SIZE (32 * 1024 * 1024) // 128MB
-#define SULOG_ENTRY_MAX_LEN 512
 #define SULOG_COMM_LEN 256
 #define DEDUP_SECS 10
 
@@ -33,42 +30,120 @@ static inline size_t strlcpy(char *dest, const char *src, size_t size)
         }                                                                      \
     } while (0)
 
-#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0)
-#include <linux/rtc.h>
+#define SULOG_ARGS_LEN 64
 
-static inline void time64_to_tm(time64_t totalsecs, int offset,
-                                struct tm *result)
-{
-    struct rtc_time rtc_tm;
-    rtc_time64_to_tm(totalsecs, &rtc_tm);
-
-    result->tm_sec = rtc_tm.tm_sec;
-    result->tm_min = rtc_tm.tm_min;
-    result->tm_hour = rtc_tm.tm_hour;
-    result->tm_mday = rtc_tm.tm_mday;
-    result->tm_mon = rtc_tm.tm_mon;
-    result->tm_year = rtc_tm.tm_year;
-}
-#endif
+enum sulog_event_type {
+    SULOG_EVT_SU_GRANT = 0,
+    SULOG_EVT_SU_ATTEMPT,
+    SULOG_EVT_PERM_CHECK,
+    SULOG_EVT_MANAGER_OP,
+    SULOG_EVT_SYSCALL,
+    SULOG_EVT_DROPPED, // count: events lost because a cpu ring was full
+};
 
-struct dedup_key {
-    u32 crc;
+// Userspace ABI of the [ksu_sulog] fd (KSU_IOCTL_GET_SULOG_FD).
+//
+// read() returns whole struct ksu_sulog_entry records and blocks (or fails
+// with EAGAIN) when there is nothing new; the file position is the sequence
+// number of the next entry. The same buffer can be mmap'ed read-only: the
+// header sits at offset 0 and entry `seq` lives at
+// data_offset + (seq % nr_entries) * entry_size. An mmap reader must copy an
+// entry and then re-read head; if head - seq >= nr_entries, the entry was
+// overwritten while being copied.
+#define KSU_SULOG_MAGIC 0x4c55534b // "KSUL"
+#define KSU_SULOG_VERSION 1
+#define SULOG_USER_ENTRIES 256 // must be a power of 2
+
+// Summary of `count` repeats of this event, suppressed by dedup until
+// ts_ns.
+#define KSU_SULOG_F_REPEAT (1 << 0)
+
+struct ksu_sulog_header {
+    __u32 magic;
+    __u32 version;
+    __u32 entry_size;
+    __u32 nr_entries;
+    __u32 data_offset;
+    __u32 reserved;
+    __u64 head; // sequence number of the next entry to be written
+};
+
+struct ksu_sulog_entry {
+    __u64 ts_ns; // CLOCK_REALTIME
+    __u32 uid;
+    __u32 target_uid;
+    __s32 pid;
+    __u32 count; // events lost for DROPPED, repeats for KSU_SULOG_F_REPEAT
+    __u8 type; // enum sulog_event_type
+    __u8 result;
+    __u8 flags;
+    __u8 reserved[5];
+    char name[32];
+    char args[SULOG_ARGS_LEN];
+    char comm[SULOG_COMM_LEN]; // full cmdline when it could be resolved
+};
+
+#define SULOG_USER_BUF_SIZE                                                    \
+    (PAGE_SIZE +                                                               \
+     PAGE_ALIGN(SULOG_USER_ENTRIES * sizeof(struct ksu_sulog_entry)))
+
+#define SULOG_RING_RECORDS 128 // per cpu, must be a power of 2
+#define SULOG_ARENA_SIZE 4096 // per cpu, must be a power of 2
+
+// Fixed-size binary record written by the reporting path. Strings (comm and
+// args, each NUL terminated) live in the per-cpu arena at args_off, which is
+// a free running offset like the ring indices. `name` must point to a static
+// string.
+struct sulog_record {
+    u64 ts_ns;
+    const char *name;
     uid_t uid;
+    uid_t target_uid;
+    pid_t pid;
+    u32 comm_hash;
+    u32 args_off;
+    u16 args_len;
     u8 type;
-    u8 _pad[1];
+    u8 result;
 };
 
-struct dedup_entry {
-    struct dedup_key key;
+// Single producer (the owning cpu, preemption disabled) and single consumer
+// (the drain path, serialized by sulog_consume_lock). Indices are free
+// running; the producer only moves head/arena_head and the consumer only
+// moves tail/arena_tail.
+struct sulog_cpu_ring {
+    u32 head;
+    u32 tail;
+    u32 arena_head;
+    u32 arena_tail;
+    u32 dropped;
+    u32 dropped_reported;
+    struct sulog_record recs[SULOG_RING_RECORDS];
+    char arena[SULOG_ARENA_SIZE];
+};
+
+// Decoded view of a record used by the consumer for dedup and formatting.
+struct sulog_event {
     u64 ts_ns;
+    uid_t uid;
+    uid_t target_uid;
+    pid_t pid;
+    u32 comm_hash;
+    u8 type;
+    u8 result;
+    const char *name;
+    char comm[TASK_COMM_LEN];
+    char args[SULOG_ARGS_LEN];
 };
 
-enum {
-    DEDUP_SU_GRANT = 0,
-    DEDUP_SU_ATTEMPT,
-    DEDUP_PERM_CHECK,
-    DEDUP_MANAGER_OP,
-    DEDUP_SYSCALL,
+#define SULOG_DEDUP_SETS 64 // must be a power of 2
+#define SULOG_DEDUP_WAYS 4
+
+struct dedup_entry {
+    struct sulog_event evt; // first occurrence in the current window
+    u32 crc;
+    u32 hits; // repeats suppressed since evt
+    u64 last_ns; // last time this entry was seen, for LRU replacement
 };
 
 static inline u32 dedup_calc_hash(const char *content, size_t len)
@@ -76,11 +151,6 @@ static inline u32 dedup_calc_hash(const char *content, size_t len)
     return crc32(0, content, len);
 }
 
-struct sulog_entry {
-    struct list_head list;
-    char content[SULOG_ENTRY_MAX_LEN];
-};
-
 void ksu_sulog_report_su_grant(uid_t uid, const char *comm, const char *method);
 void ksu_sulog_report_su_attempt(uid_t uid, const char *comm,
                                  const char *target_path, bool success);
@@ -91,6 +161,8 @@ void ksu_sulog_report_manager_operation(const char *operation,
 void ksu_sulog_report_syscall(uid_t uid, const char *comm, const char *syscall,
                               const char *args);
 
+int ksu_sulog_install_fd(unsigned int flags);
+
 int ksu_sulog_init(void);
 void ksu_sulog_exit(void);
 #endif // __SULOG_GATE
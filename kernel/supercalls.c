@@ -5,6 +5,8 @@
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/hashtable.h>
+#include <linux/jhash.h>
 #include <linux/slab.h>
 #include <linux/kprobes.h>
 #include <linux/syscalls.h>
@@ -15,6 +17,7 @@
 #include "supercalls.h"
 #include "arch.h"
 #include "allowlist.h"
+#include "boot_timeline.h"
 #include "feature.h"
 #include "klog.h" // IWYU pragma: keep
 #include "ksud.h"
@@ -23,6 +26,7 @@
 #include "selinux/selinux.h"
 #include "file_wrapper.h"
 #include "syscall_hook_manager.h"
+#include "status_page.h"
 
 #include "sulog.h"
 #ifdef CONFIG_KSU_MANUAL_SU
@@ -457,9 +461,76 @@ static int do_nuke_ext4_sysfs(void __user *arg)
 struct list_head mount_list = LIST_HEAD_INIT(mount_list);
 DECLARE_RWSEM(mount_list_lock);
 
+// Index over mount_list for dedup and delete; the list keeps the order the
+// umount walk is built from. Both are protected by mount_list_lock.
+#define MOUNT_HASH_BITS 8
+static DEFINE_HASHTABLE(mount_hash, MOUNT_HASH_BITS);
+
+static u32 mount_path_hash(const char *path)
+{
+    return jhash(path, strlen(path), 0);
+}
+
+static struct mount_entry *find_mount_entry_locked(const char *path, u32 hash)
+{
+    struct mount_entry *entry;
+
+    hash_for_each_possible (mount_hash, entry, hnode, hash) {
+        if (entry->hash == hash && !strcmp(entry->umountable, path))
+            return entry;
+    }
+
+    return NULL;
+}
+
+static struct mount_entry *new_mount_entry(const char *path,
+                                           unsigned int flags)
+{
+    struct mount_entry *entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+
+    if (!entry)
+        return NULL;
+
+    entry->umountable = kstrdup(path, GFP_KERNEL);
+    if (!entry->umountable) {
+        kfree(entry);
+        return NULL;
+    }
+    entry->flags = flags;
+    entry->hash = mount_path_hash(entry->umountable);
+
+    return entry;
+}
+
+static void free_mount_entry(struct mount_entry *entry)
+{
+    kfree(entry->umountable);
+    kfree(entry);
+}
+
+// Returns false if the path is already listed. mount_list_lock must be held
+// for writing.
+static bool add_mount_entry_locked(struct mount_entry *new_entry)
+{
+    if (find_mount_entry_locked(new_entry->umountable, new_entry->hash))
+        return false;
+
+    list_add(&new_entry->list, &mount_list);
+    hash_add(mount_hash, &new_entry->hnode, new_entry->hash);
+    return true;
+}
+
+// mount_list_lock must be held for writing
+static void del_mount_entry_locked(struct mount_entry *entry)
+{
+    list_del(&entry->list);
+    hash_del(&entry->hnode);
+    free_mount_entry(entry);
+}
+
 static int add_try_umount(void __user *arg)
 {
-    struct mount_entry *new_entry, *entry, *tmp;
+    struct mount_entry *new_entry, *entry;
     struct ksu_add_try_umount_cmd cmd;
     char buf[256] = { 0 };
 
@@ -473,10 +544,9 @@ static int add_try_umount(void __user *arg)
         list_for_each_entry_safe (entry, tmp, &mount_list, list) {
             pr_info("wipe_umount_list: removing entry: %s\n",
                     entry->umountable);
-            list_del(&entry->list);
-            kfree(entry->umountable);
-            kfree(entry);
+            del_mount_entry_locked(entry);
         }
+        ksu_umount_list_changed();
         up_write(&mount_list_lock);
 
         return 0;
@@ -489,46 +559,25 @@ static int add_try_umount(void __user *arg)
 
         buf[sizeof(buf) - 1] = '\0';
 
-        new_entry = kzalloc(sizeof(*new_entry), GFP_KERNEL);
+        new_entry = new_mount_entry(buf, cmd.flags);
         if (!new_entry)
             return -ENOMEM;
 
-        new_entry->umountable = kstrdup(buf, GFP_KERNEL);
-        if (!new_entry->umountable) {
-            kfree(new_entry);
-            return -1;
-        }
-
         down_write(&mount_list_lock);
-
         // disallow dupes
-        // if this gets too many, we can consider moving this whole task to a kthread
-        list_for_each_entry (entry, &mount_list, list) {
-            if (!strcmp(entry->umountable, buf)) {
-                pr_info("cmd_add_try_umount: %s is already here!\n", buf);
-                up_write(&mount_list_lock);
-                kfree(new_entry->umountable);
-                kfree(new_entry);
-                return -1;
-            }
+        if (!add_mount_entry_locked(new_entry)) {
+            up_write(&mount_list_lock);
+            pr_info("cmd_add_try_umount: %s is already here!\n", buf);
+            free_mount_entry(new_entry);
+            return -1;
         }
-
-        // now check flags and add
-        // this also serves as a null check
-        if (cmd.flags)
-            new_entry->flags = cmd.flags;
-        else
-            new_entry->flags = 0;
-
-        // debug
-        list_add(&new_entry->list, &mount_list);
+        ksu_umount_list_changed();
         up_write(&mount_list_lock);
         pr_info("cmd_add_try_umount: %s added!\n", buf);
 
         return 0;
     }
 
-    // this is just strcmp'd wipe anyway
     case KSU_UMOUNT_DEL: {
         long len = strncpy_from_user(buf, (const char __user *)cmd.arg,
                                      sizeof(buf) - 1);
@@ -538,14 +587,12 @@ static int add_try_umount(void __user *arg)
         buf[sizeof(buf) - 1] = '\0';
 
         down_write(&mount_list_lock);
-        list_for_each_entry_safe (entry, tmp, &mount_list, list) {
-            if (!strcmp(entry->umountable, buf)) {
-                pr_info("cmd_add_try_umount: entry removed: %s\n",
-                        entry->umountable);
-                list_del(&entry->list);
-                kfree(entry->umountable);
-                kfree(entry);
-            }
+        entry = find_mount_entry_locked(buf, mount_path_hash(buf));
+        if (entry) {
+            pr_info("cmd_add_try_umount: entry removed: %s\n",
+                    entry->umountable);
+            del_mount_entry_locked(entry);
+            ksu_umount_list_changed();
         }
         up_write(&mount_list_lock);
 
@@ -613,6 +660,257 @@ static int list_try_umount(void __user *arg)
     return ret;
 }
 
+#if __SULOG_GATE
+static int do_get_sulog_fd(void __user *arg)
+{
+    struct ksu_get_sulog_fd_cmd cmd;
+
+    if (copy_from_user(&cmd, arg, sizeof(cmd))) {
+        pr_err("get_sulog_fd: copy_from_user failed\n");
+        return -EFAULT;
+    }
+
+    return ksu_sulog_install_fd(cmd.flags);
+}
+#endif
+
+// Direct lookup by _IOC_NR(cmd), filled from ksu_ioctl_handlers[] at init
+static const struct ksu_ioctl_cmd_map *ksu_ioctl_table[1 << _IOC_NRBITS]
+    __read_mostly;
+
+static inline void ksu_ioctl_audit(const struct ksu_ioctl_cmd_map *map,
+                                   uid_t uid, int ret)
+{
+#if __SULOG_GATE
+    const char *result;
+
+    if (map->audit == KSU_AUDIT_NEVER ||
+        (map->audit == KSU_AUDIT_ON_DENY && ret != -EPERM))
+        return;
+
+    result = (ret == 0)      ? "SUCCESS" :
+             (ret == -EPERM) ? "DENIED" :
+                               "FAILED";
+    ksu_sulog_report_syscall(uid, NULL, map->name, result);
+#endif
+}
+
+static bool root_passes(ksu_perm_check_t perm_check)
+{
+    return perm_check == only_root || perm_check == manager_or_root ||
+           perm_check == always_allow;
+}
+
+// Run a list of commands in order under the caller's single (root) check.
+// Commands root could not run directly are refused with -EPERM.
+static int do_batch(void __user *arg)
+{
+    struct ksu_batch_cmd cmd;
+    struct ksu_batch_entry entry;
+    struct ksu_batch_entry __user *uentries;
+    const struct ksu_ioctl_cmd_map *map;
+    int ret = 0;
+
+    if (copy_from_user(&cmd, arg, sizeof(cmd))) {
+        pr_err("batch: copy_from_user failed\n");
+        return -EFAULT;
+    }
+
+    if (cmd.count > KSU_BATCH_MAX)
+        return -E2BIG;
+
+    uentries = (struct ksu_batch_entry __user *)cmd.entries;
+
+    for (cmd.done = 0; cmd.done < cmd.count;) {
+        if (copy_from_user(&entry, &uentries[cmd.done], sizeof(entry))) {
+            ret = -EFAULT;
+            break;
+        }
+        cmd.done++;
+
+        map = ksu_ioctl_table[_IOC_NR(entry.cmd)];
+        if (!map || map->cmd != entry.cmd || map->handler == do_batch) {
+            ret = -ENOTTY;
+        } else if (!root_passes(map->perm_check)) {
+            ret = -EPERM;
+        } else {
+            ret = map->handler((void __user *)entry.arg);
+            ksu_ioctl_audit(map, current_uid().val, ret);
+        }
+
+        entry.result = ret;
+        if (put_user(entry.result, &uentries[cmd.done - 1].result)) {
+            ret = -EFAULT;
+            break;
+        }
+
+        if (ret < 0)
+            break;
+    }
+
+    if (copy_to_user(arg, &cmd, sizeof(cmd))) {
+        pr_err("batch: copy_to_user failed\n");
+        return -EFAULT;
+    }
+
+    return ret < 0 ? ret : 0;
+}
+
+static int get_try_umount(void __user *arg)
+{
+    struct ksu_get_try_umount_cmd cmd;
+    struct ksu_umount_record *rec;
+    struct mount_entry *entry;
+    char *kbuf;
+    size_t offset = 0;
+    u32 index = 0;
+    int ret = 0;
+
+    if (copy_from_user(&cmd, arg, sizeof(cmd)))
+        return -EFAULT;
+
+    if (!cmd.buf || !cmd.buf_size)
+        return -EINVAL;
+
+    cmd.buf_size = min_t(u32, cmd.buf_size, KSU_UMOUNT_BUF_MAX);
+    kbuf = kzalloc(cmd.buf_size, GFP_KERNEL);
+    if (!kbuf)
+        return -ENOMEM;
+
+    cmd.count = 0;
+
+    down_read(&mount_list_lock);
+    list_for_each_entry (entry, &mount_list, list) {
+        size_t len, size;
+
+        if (index++ < cmd.cursor || ret)
+            continue;
+
+        len = strlen(entry->umountable);
+        size = KSU_UMOUNT_RECORD_SIZE(len);
+        if (offset + size > cmd.buf_size) {
+            // keep counting for total, the caller comes back for the rest
+            ret = cmd.count ? 1 : -ENOSPC;
+            continue;
+        }
+
+        rec = (struct ksu_umount_record *)(kbuf + offset);
+        rec->flags = entry->flags;
+        rec->len = len;
+        memcpy(rec->path, entry->umountable, len + 1);
+        offset += size;
+        cmd.count++;
+    }
+    up_read(&mount_list_lock);
+
+    cmd.total = index;
+    cmd.cursor = min(cmd.cursor, cmd.total) + cmd.count;
+
+    if (ret < 0)
+        goto out;
+
+    ret = 0;
+    if (copy_to_user((void __user *)cmd.buf, kbuf, offset) ||
+        copy_to_user(arg, &cmd, sizeof(cmd)))
+        ret = -EFAULT;
+
+out:
+    kfree(kbuf);
+    return ret;
+}
+
+static int add_try_umount_bulk(void __user *arg)
+{
+    struct ksu_add_try_umount_bulk_cmd cmd;
+    struct ksu_umount_record *rec;
+    struct mount_entry *entry, *tmp;
+    LIST_HEAD(pending);
+    char *kbuf;
+    size_t offset = 0;
+    u32 i;
+    int ret = 0;
+
+    if (copy_from_user(&cmd, arg, sizeof(cmd)))
+        return -EFAULT;
+
+    if (!cmd.buf || !cmd.buf_size || cmd.buf_size > KSU_UMOUNT_BUF_MAX)
+        return -EINVAL;
+
+    kbuf = memdup_user((const void __user *)cmd.buf, cmd.buf_size);
+    if (IS_ERR(kbuf))
+        return PTR_ERR(kbuf);
+
+    // parse and allocate everything first, so the list lock is taken once
+    for (i = 0; i < cmd.count; i++) {
+        if (cmd.buf_size - offset < sizeof(*rec)) {
+            ret = -EINVAL;
+            goto out;
+        }
+        rec = (struct ksu_umount_record *)(kbuf + offset);
+        if (!rec->len || rec->len >= 256 ||
+            KSU_UMOUNT_RECORD_SIZE(rec->len) > cmd.buf_size - offset ||
+            rec->path[rec->len] != '\0' ||
+            strnlen(rec->path, rec->len) != rec->len) {
+            ret = -EINVAL;
+            goto out;
+        }
+
+        entry = new_mount_entry(rec->path, rec->flags);
+        if (!entry) {
+            ret = -ENOMEM;
+            goto out;
+        }
+        list_add_tail(&entry->list, &pending);
+        offset += KSU_UMOUNT_RECORD_SIZE(rec->len);
+    }
+
+    cmd.added = 0;
+    down_write(&mount_list_lock);
+    list_for_each_entry_safe (entry, tmp, &pending, list) {
+        list_del(&entry->list);
+        if (add_mount_entry_locked(entry))
+            cmd.added++;
+        else
+            free_mount_entry(entry);
+    }
+    if (cmd.added)
+        ksu_umount_list_changed();
+    up_write(&mount_list_lock);
+
+    pr_info("add_try_umount_bulk: %u of %u added\n", cmd.added, cmd.count);
+
+    if (copy_to_user(arg, &cmd, sizeof(cmd)))
+        ret = -EFAULT;
+
+out:
+    list_for_each_entry_safe (entry, tmp, &pending, list) {
+        list_del(&entry->list);
+        free_mount_entry(entry);
+    }
+    kfree(kbuf);
+    return ret;
+}
+
+static int do_get_boot_timeline(void __user *arg)
+{
+    struct ksu_get_boot_timeline_cmd *cmd;
+    int ret = 0;
+
+    cmd = kzalloc(sizeof(*cmd), GFP_KERNEL);
+    if (!cmd)
+        return -ENOMEM;
+
+    cmd->count = ksu_boot_timeline_read(cmd->phases, KSU_BOOT_PHASE_MAX);
+
+    if (copy_to_user(arg, cmd, sizeof(*cmd))) {
+        pr_err("get_boot_timeline: copy_to_user failed\n");
+        ret = -EFAULT;
+    }
+
+    kfree(cmd);
+    return ret;
+}
+
 // 100. GET_FULL_VERSION - Get full version string
 static int do_get_full_version(void __user *arg)
 {
@@ -636,12 +934,11 @@ static int do_get_full_version(void __user *arg)
 static int do_get_hook_type(void __user *arg)
 {
     struct ksu_hook_type_cmd cmd = { 0 };
-    const char *type = "Tracepoint";
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 13, 0)
-    strscpy(cmd.hook_type, type, sizeof(cmd.hook_type));
+    strscpy(cmd.hook_type, KSU_HOOK_TYPE, sizeof(cmd.hook_type));
 #else
-    strlcpy(cmd.hook_type, type, sizeof(cmd.hook_type));
+    strlcpy(cmd.hook_type, KSU_HOOK_TYPE, sizeof(cmd.hook_type));
 #endif
 
     if (copy_to_user(arg, &cmd, sizeof(cmd))) {
@@ -717,103 +1014,154 @@ static const struct ksu_ioctl_cmd_map ksu_ioctl_handlers[] = {
     { .cmd = KSU_IOCTL_GRANT_ROOT,
       .name = "GRANT_ROOT",
       .handler = do_grant_root,
-      .perm_check = allowed_for_su },
+      .perm_check = allowed_for_su,
+      .audit = KSU_AUDIT_ALWAYS },
     { .cmd = KSU_IOCTL_GET_INFO,
       .name = "GET_INFO",
       .handler = do_get_info,
-      .perm_check = always_allow },
+      .perm_check = always_allow,
+      .audit = KSU_AUDIT_NEVER },
     { .cmd = KSU_IOCTL_REPORT_EVENT,
       .name = "REPORT_EVENT",
       .handler = do_report_event,
-      .perm_check = only_root },
+      .perm_check = only_root,
+      .audit = KSU_AUDIT_ALWAYS },
     { .cmd = KSU_IOCTL_SET_SEPOLICY,
       .name = "SET_SEPOLICY",
       .handler = do_set_sepolicy,
-      .perm_check = only_root },
+      .perm_check = only_root,
+      .audit = KSU_AUDIT_ALWAYS },
     { .cmd = KSU_IOCTL_CHECK_SAFEMODE,
       .name = "CHECK_SAFEMODE",
       .handler = do_check_safemode,
-      .perm_check = always_allow },
+      .perm_check = always_allow,
+      .audit = KSU_AUDIT_NEVER },
     { .cmd = KSU_IOCTL_GET_ALLOW_LIST,
       .name = "GET_ALLOW_LIST",
       .handler = do_get_allow_list,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ON_DENY },
     { .cmd = KSU_IOCTL_GET_DENY_LIST,
       .name = "GET_DENY_LIST",
       .handler = do_get_deny_list,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ON_DENY },
     { .cmd = KSU_IOCTL_UID_GRANTED_ROOT,
       .name = "UID_GRANTED_ROOT",
       .handler = do_uid_granted_root,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ON_DENY },
     { .cmd = KSU_IOCTL_UID_SHOULD_UMOUNT,
       .name = "UID_SHOULD_UMOUNT",
       .handler = do_uid_should_umount,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ON_DENY },
     { .cmd = KSU_IOCTL_GET_MANAGER_APPID,
       .name = "GET_MANAGER_APPID",
       .handler = do_get_manager_appid,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ON_DENY },
     { .cmd = KSU_IOCTL_GET_APP_PROFILE,
       .name = "GET_APP_PROFILE",
       .handler = do_get_app_profile,
-      .perm_check = only_manager },
+      .perm_check = only_manager,
+      .audit = KSU_AUDIT_ON_DENY },
     { .cmd = KSU_IOCTL_SET_APP_PROFILE,
       .name = "SET_APP_PROFILE",
       .handler = do_set_app_profile,
-      .perm_check = only_manager },
+      .perm_check = only_manager,
+      .audit = KSU_AUDIT_ALWAYS },
     { .cmd = KSU_IOCTL_GET_FEATURE,
       .name = "GET_FEATURE",
       .handler = do_get_feature,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_NEVER },
     { .cmd = KSU_IOCTL_SET_FEATURE,
       .name = "SET_FEATURE",
       .handler = do_set_feature,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ALWAYS },
     { .cmd = KSU_IOCTL_GET_WRAPPER_FD,
       .name = "GET_WRAPPER_FD",
       .handler = do_get_wrapper_fd,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ALWAYS },
     { .cmd = KSU_IOCTL_MANAGE_MARK,
       .name = "MANAGE_MARK",
       .handler = do_manage_mark,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ALWAYS },
     { .cmd = KSU_IOCTL_NUKE_EXT4_SYSFS,
       .name = "NUKE_EXT4_SYSFS",
       .handler = do_nuke_ext4_sysfs,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ALWAYS },
     { .cmd = KSU_IOCTL_ADD_TRY_UMOUNT,
       .name = "ADD_TRY_UMOUNT",
       .handler = add_try_umount,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ALWAYS },
+    { .cmd = KSU_IOCTL_GET_TRY_UMOUNT,
+      .name = "GET_TRY_UMOUNT",
+      .handler = get_try_umount,
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ON_DENY },
+    { .cmd = KSU_IOCTL_ADD_TRY_UMOUNT_BULK,
+      .name = "ADD_TRY_UMOUNT_BULK",
+      .handler = add_try_umount_bulk,
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ALWAYS },
+    { .cmd = KSU_IOCTL_GET_BOOT_TIMELINE,
+      .name = "GET_BOOT_TIMELINE",
+      .handler = do_get_boot_timeline,
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ON_DENY },
+    { .cmd = KSU_IOCTL_BATCH,
+      .name = "BATCH",
+      .handler = do_batch,
+      .perm_check = only_root,
+      .audit = KSU_AUDIT_ON_DENY },
+#if __SULOG_GATE
+    { .cmd = KSU_IOCTL_GET_SULOG_FD,
+      .name = "GET_SULOG_FD",
+      .handler = do_get_sulog_fd,
+      .perm_check = only_root,
+      .audit = KSU_AUDIT_ALWAYS },
+#endif
     { .cmd = KSU_IOCTL_GET_FULL_VERSION,
       .name = "GET_FULL_VERSION",
       .handler = do_get_full_version,
-      .perm_check = always_allow },
+      .perm_check = always_allow,
+      .audit = KSU_AUDIT_NEVER },
     { .cmd = KSU_IOCTL_HOOK_TYPE,
       .name = "GET_HOOK_TYPE",
       .handler = do_get_hook_type,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ON_DENY },
     { .cmd = KSU_IOCTL_ENABLE_KPM,
       .name = "GET_ENABLE_KPM",
       .handler = do_enable_kpm,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ON_DENY },
 #ifdef CONFIG_KSU_MANUAL_SU
     { .cmd = KSU_IOCTL_MANUAL_SU,
       .name = "MANUAL_SU",
       .handler = do_manual_su,
-      .perm_check = system_uid_check },
+      .perm_check = system_uid_check,
+      .audit = KSU_AUDIT_ALWAYS },
 #endif
 #ifdef CONFIG_KPM
     { .cmd = KSU_IOCTL_KPM,
       .name = "KPM_OPERATION",
       .handler = do_kpm,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ALWAYS },
 #endif
     { .cmd = KSU_IOCTL_LIST_TRY_UMOUNT,
       .name = "LIST_TRY_UMOUNT",
       .handler = list_try_umount,
-      .perm_check = manager_or_root },
+      .perm_check = manager_or_root,
+      .audit = KSU_AUDIT_ON_DENY },
     { .cmd = 0, .name = NULL, .handler = NULL, .perm_check = NULL } // Sentinel
 };
 
@@ -896,12 +1244,21 @@ static struct kprobe reboot_kp = {
 
 void ksu_supercalls_init(void)
 {
+    const struct ksu_ioctl_cmd_map *map;
     int i;
 
     pr_info("KernelSU IOCTL Commands:\n");
     for (i = 0; ksu_ioctl_handlers[i].handler; i++) {
-        pr_info("  %-18s = 0x%08x\n", ksu_ioctl_handlers[i].name,
-                ksu_ioctl_handlers[i].cmd);
+        map = &ksu_ioctl_handlers[i];
+        pr_info("  %-18s = 0x%08x\n", map->name, map->cmd);
+
+        // first entry wins, like the linear scan this table replaces
+        if (ksu_ioctl_table[_IOC_NR(map->cmd)]) {
+            pr_warn("ksu ioctl: %s shadowed by %s\n", map->name,
+                    ksu_ioctl_table[_IOC_NR(map->cmd)]->name);
+            continue;
+        }
+        ksu_ioctl_table[_IOC_NR(map->cmd)] = map;
     }
     int rc = register_kprobe(&reboot_kp);
     if (rc) {
@@ -916,49 +1273,36 @@ void ksu_supercalls_exit(void)
     unregister_kprobe(&reboot_kp);
 }
 
-static inline void ksu_ioctl_audit(unsigned int cmd, const char *cmd_name,
-                                   uid_t uid, int ret)
-{
-#if __SULOG_GATE
-    const char *result = (ret == 0)      ? "SUCCESS" :
-                         (ret == -EPERM) ? "DENIED" :
-                                           "FAILED";
-    ksu_sulog_report_syscall(uid, NULL, cmd_name, result);
-#endif
-}
-
 // IOCTL dispatcher
 static long anon_ksu_ioctl(struct file *filp, unsigned int cmd,
                            unsigned long arg)
 {
     void __user *argp = (void __user *)arg;
-    int i;
+    const struct ksu_ioctl_cmd_map *map;
+    int ret;
 
 #ifdef CONFIG_KSU_DEBUG
     pr_info("ksu ioctl: cmd=0x%x from uid=%d\n", cmd, current_uid().val);
 #endif
 
-    for (i = 0; ksu_ioctl_handlers[i].handler; i++) {
-        if (cmd == ksu_ioctl_handlers[i].cmd) {
-            // Check permission first
-            if (ksu_ioctl_handlers[i].perm_check &&
-                !ksu_ioctl_handlers[i].perm_check()) {
-                pr_warn("ksu ioctl: permission denied for cmd=0x%x uid=%d\n",
-                        cmd, current_uid().val);
-                ksu_ioctl_audit(cmd, ksu_ioctl_handlers[i].name,
-                                current_uid().val, -EPERM);
-                return -EPERM;
-            }
-            // Execute handler
-            int ret = ksu_ioctl_handlers[i].handler(argp);
-            ksu_ioctl_audit(cmd, ksu_ioctl_handlers[i].name, current_uid().val,
-                            ret);
-            return ret;
-        }
+    map = ksu_ioctl_table[_IOC_NR(cmd)];
+    if (unlikely(!map || map->cmd != cmd)) {
+        pr_warn("ksu ioctl: unsupported command 0x%x\n", cmd);
+        return -ENOTTY;
+    }
+
+    // Check permission first
+    if (map->perm_check && !map->perm_check()) {
+        pr_warn("ksu ioctl: permission denied for cmd=0x%x uid=%d\n", cmd,
+                current_uid().val);
+        ksu_ioctl_audit(map, current_uid().val, -EPERM);
+        return -EPERM;
     }
 
-    pr_warn("ksu ioctl: unsupported command 0x%x\n", cmd);
-    return -ENOTTY;
+    // Execute handler
+    ret = map->handler(argp);
+    ksu_ioctl_audit(map, current_uid().val, ret);
+    return ret;
 }
 
 // File release handler
@@ -968,11 +1312,22 @@ static int anon_ksu_release(struct inode *inode, struct file *filp)
     return 0;
 }
 
+// Status page mmap handler, gated like GET_FEATURE and GET_MANAGER_APPID
+// whose values the page carries
+static int anon_ksu_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    if (!manager_or_root())
+        return -EPERM;
+
+    return ksu_status_page_mmap(filp, vma);
+}
+
 // File operations structure
 static const struct file_operations anon_ksu_fops = {
     .owner = THIS_MODULE,
     .unlocked_ioctl = anon_ksu_ioctl,
     .compat_ioctl = anon_ksu_ioctl,
+    .mmap = anon_ksu_mmap,
     .release = anon_ksu_release,
 };
 
@@ -104,16 +104,90 @@ struct ksu_add_try_umount_cmd {
     __u8 mode; // denotes what to do with it 0:wipe_list 1:add_to_list 2:delete_entry
 };
 
+struct ksu_get_sulog_fd_cmd {
+    __u32 flags; // Input: O_NONBLOCK or 0
+};
+
+struct ksu_batch_entry {
+    __u32 cmd; // Input: KSU_IOCTL_* command
+    __s32 result; // Output: return value of the command
+    __aligned_u64 arg; // Input: argument of the command
+};
+
+struct ksu_batch_cmd {
+    __aligned_u64 entries; // Input: struct ksu_batch_entry array
+    __u32 count; // Input: number of entries, at most KSU_BATCH_MAX
+    __u32 done; // Output: entries executed, including a failed one
+};
+
+#define KSU_BATCH_MAX 256
+
 // List current umount entries
 struct ksu_list_try_umount_cmd {
     __aligned_u64 arg; // User buffer
     __u32 buf_size; // Buffer size provided by userspace
 };
 
+// Record format shared by GET_TRY_UMOUNT and ADD_TRY_UMOUNT_BULK: records
+// are packed back to back, each one KSU_UMOUNT_RECORD_SIZE(len) bytes long.
+struct ksu_umount_record {
+    __u32 flags; // umount flags
+    __u32 len; // strlen(path)
+    char path[]; // NUL terminated, padded to an 8 byte boundary
+};
+
+#define KSU_UMOUNT_RECORD_SIZE(len)                                            \
+    ALIGN(sizeof(struct ksu_umount_record) + (len) + 1, 8)
+#define KSU_UMOUNT_BUF_MAX (64 * 1024)
+
+// Page through the umount list; call again with the returned cursor until
+// cursor == total
+struct ksu_get_try_umount_cmd {
+    __aligned_u64 buf; // Input: user buffer for records
+    __u32 buf_size; // Input: size of buf
+    __u32 cursor; // Input/Output: index of the first entry to return
+    __u32 count; // Output: records written to buf
+    __u32 total; // Output: number of entries in the list
+};
+
+struct ksu_add_try_umount_bulk_cmd {
+    __aligned_u64 buf; // Input: records to add
+    __u32 buf_size; // Input: size of buf
+    __u32 count; // Input: number of records in buf
+    __u32 added; // Output: records added, duplicates are skipped
+};
+
 #define KSU_UMOUNT_WIPE 0 // ignore everything and wipe list
 #define KSU_UMOUNT_ADD 1 // add entry (path + flags)
 #define KSU_UMOUNT_DEL 2 // delete entry, strcmp
 
+// Boot phases the kernel timestamps, indexes into GET_BOOT_TIMELINE's phases
+#define KSU_BOOT_MODULE_INIT 0
+#define KSU_BOOT_SECOND_STAGE 1 // init second_stage exec
+#define KSU_BOOT_SEPOLICY 2 // apply_kernelsu_rules
+#define KSU_BOOT_FIRST_APP_PROCESS 3
+#define KSU_BOOT_POST_FS_DATA 4
+#define KSU_BOOT_LOAD_ALLOW_LIST 5
+#define KSU_BOOT_OBSERVER_INIT 6
+#define KSU_BOOT_MODULE_MOUNTED 7
+#define KSU_BOOT_COMPLETED 8
+#define KSU_BOOT_STOP_VFS_READ_HOOK 9
+#define KSU_BOOT_STOP_EXECVE_HOOK 10
+#define KSU_BOOT_STOP_INPUT_HOOK 11
+#define KSU_BOOT_PHASE_COUNT 12
+#define KSU_BOOT_PHASE_MAX 32
+
+struct ksu_boot_phase {
+    __aligned_u64 begin_ns; // CLOCK_MONOTONIC, 0 if the phase didn't happen
+    __aligned_u64 end_ns; // same as begin_ns for instant events
+};
+
+struct ksu_get_boot_timeline_cmd {
+    __u32 count; // Output: phases known to this kernel
+    __u32 reserved;
+    struct ksu_boot_phase phases[KSU_BOOT_PHASE_MAX]; // Output
+};
+
 // Other command structures
 struct ksu_get_full_version_cmd {
     char version_full[KSU_FULL_VERSION_STRING]; // Output: full version string
@@ -155,6 +229,11 @@ struct ksu_manual_su_cmd {
 #define KSU_IOCTL_MANAGE_MARK _IOC(_IOC_READ | _IOC_WRITE, 'K', 16, 0)
 #define KSU_IOCTL_NUKE_EXT4_SYSFS _IOC(_IOC_WRITE, 'K', 17, 0)
 #define KSU_IOCTL_ADD_TRY_UMOUNT _IOC(_IOC_WRITE, 'K', 18, 0)
+#define KSU_IOCTL_GET_SULOG_FD _IOC(_IOC_WRITE, 'K', 19, 0)
+#define KSU_IOCTL_BATCH _IOC(_IOC_READ | _IOC_WRITE, 'K', 20, 0)
+#define KSU_IOCTL_GET_TRY_UMOUNT _IOC(_IOC_READ | _IOC_WRITE, 'K', 21, 0)
+#define KSU_IOCTL_ADD_TRY_UMOUNT_BULK _IOC(_IOC_READ | _IOC_WRITE, 'K', 22, 0)
+#define KSU_IOCTL_GET_BOOT_TIMELINE _IOC(_IOC_READ, 'K', 23, 0)
 // Other IOCTL command definitions
 #define KSU_IOCTL_GET_FULL_VERSION _IOC(_IOC_READ, 'K', 100, 0)
 #define KSU_IOCTL_HOOK_TYPE _IOC(_IOC_READ, 'K', 101, 0)
@@ -168,12 +247,20 @@ struct ksu_manual_su_cmd {
 typedef int (*ksu_ioctl_handler_t)(void __user *arg);
 typedef bool (*ksu_perm_check_t)(void);
 
+// When an ioctl is reported to sulog
+enum ksu_ioctl_audit {
+    KSU_AUDIT_NEVER = 0,
+    KSU_AUDIT_ON_DENY, // only permission denials
+    KSU_AUDIT_ALWAYS,
+};
+
 // IOCTL command mapping
 struct ksu_ioctl_cmd_map {
     unsigned int cmd;
     const char *name;
     ksu_ioctl_handler_t handler;
     ksu_perm_check_t perm_check; // Permission check function
+    enum ksu_ioctl_audit audit;
 };
 
 // Install KSU fd to current process
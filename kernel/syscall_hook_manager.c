@@ -338,8 +338,9 @@ static void ksu_sys_enter_handler(void *data, struct pt_regs *regs, long id)
         }
 
 #ifdef CONFIG_KSU_MANUAL_SU
-        // Handle task_alloc via clone/fork
-        if (id == __NR_clone || id == __NR_clone3)
+        // Handle task_alloc via clone/fork, only while a grant is pending
+        if (ksu_manual_su_has_pending() &&
+            (id == __NR_clone || id == __NR_clone3))
             return ksu_handle_task_alloc(regs);
 #endif
     }
@@ -10,6 +10,9 @@
 #include <linux/fs.h>
 #include "selinux/selinux.h"
 
+// Reported by the HOOK_TYPE ioctl and the status page
+#define KSU_HOOK_TYPE "Tracepoint"
+
 // Hook manager initialization and cleanup
 void ksu_syscall_hook_manager_init(void);
 void ksu_syscall_hook_manager_exit(void);
@@ -1,13 +1,29 @@
+#include <linux/cred.h>
 #include <linux/err.h>
 #include <linux/fs.h>
+#include <linux/hashtable.h>
+#include <linux/jhash.h>
 #include <linux/list.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/namei.h>
+#include <linux/pid.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/stat.h>
 #include <linux/string.h>
+#include <linux/task_work.h>
 #include <linux/types.h>
 #include <linux/version.h>
+#include <linux/workqueue.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+#include <linux/sched/task.h>
+#endif
 
 #include "allowlist.h"
+#include "apk_sign.h"
 #include "klog.h" // IWYU pragma: keep
+#include "ksu.h"
 #include "manager.h"
 #include "throne_tracker.h"
 
@@ -15,12 +31,59 @@ uid_t ksu_manager_appid = KSU_INVALID_APPID;
 
 #define SYSTEM_PACKAGES_LIST_PATH "/data/system/packages.list"
 
+// (uid, package) pairs from packages.list, kept across track_throne calls
+// and keyed by uid. An entry not seen in the latest scan has disappeared.
 struct uid_data {
-    struct list_head list;
+    struct hlist_node node;
     u32 uid;
+    u32 gen;
     char package[KSU_MAX_PACKAGE_NAME];
 };
 
+#define UID_INDEX_BITS 10
+static DEFINE_HASHTABLE(uid_index, UID_INDEX_BITS);
+static u32 uid_index_gen;
+// digest of the packages.list content the index was built from
+static u32 packages_list_digest;
+static bool packages_list_indexed;
+static DEFINE_MUTEX(throne_lock);
+
+static struct uid_data *uid_index_find(u32 uid, const char *package)
+{
+    struct uid_data *np;
+
+    hash_for_each_possible (uid_index, np, node, uid) {
+        if (np->uid == uid &&
+            strncmp(np->package, package, KSU_MAX_PACKAGE_NAME) == 0)
+            return np;
+    }
+    return NULL;
+}
+
+static bool uid_index_has_uid(u32 uid)
+{
+    struct uid_data *np;
+
+    hash_for_each_possible (uid_index, np, node, uid) {
+        if (np->uid == uid)
+            return true;
+    }
+    return false;
+}
+
+static void uid_index_clear(void)
+{
+    struct uid_data *np;
+    struct hlist_node *tmp;
+    int bkt;
+
+    hash_for_each_safe (uid_index, bkt, tmp, np, node) {
+        hash_del(&np->node);
+        kfree(np);
+    }
+    packages_list_indexed = false;
+}
+
 static int get_pkg_from_apk_path(char *pkg, const char *path)
 {
     int len = strlen(path);
@@ -60,7 +123,7 @@ static int get_pkg_from_apk_path(char *pkg, const char *path)
     return 0;
 }
 
-static void crown_manager(const char *apk, struct list_head *uid_data)
+static void crown_manager(const char *apk)
 {
     char pkg[KSU_MAX_PACKAGE_NAME];
     if (get_pkg_from_apk_path(pkg, apk) < 0) {
@@ -78,10 +141,10 @@ static void crown_manager(const char *apk, struct list_head *uid_data)
         return;
     }
 #endif
-    struct list_head *list = (struct list_head *)uid_data;
     struct uid_data *np;
+    int bkt;
 
-    list_for_each_entry (np, list, list) {
+    hash_for_each (uid_index, bkt, np, node) {
         if (strncmp(np->package, pkg, KSU_MAX_PACKAGE_NAME) == 0) {
             pr_info("Crowning manager: %s(uid=%d)\n", pkg, np->uid);
             ksu_set_manager_appid(np->uid);
@@ -98,19 +161,182 @@ struct data_path {
     struct list_head list;
 };
 
-struct apk_path_hash {
-    unsigned int hash;
-    bool exists;
-    struct list_head list;
+/*
+ * base.apk files known not to be the manager, identified by what changes on
+ * every install or update of the file. Only negative verdicts are kept: a
+ * positive one crowns the manager and ends the search anyway. The cache is
+ * saved to APK_VERDICT_PATH so the first search after boot is cheap, and
+ * tied to the set of manager keys it was computed against.
+ */
+#define APK_VERDICT_PATH "/data/adb/ksu/.apk_verdicts"
+#define APK_VERDICT_MAGIC 0x5641534b // KSAV
+#define APK_VERDICT_VERSION 1
+#define APK_VERDICT_MAX 4096
+
+struct apk_key {
+    u64 ino;
+    s64 size;
+    s64 mtime_sec;
+    u32 mtime_nsec;
+    u32 dev;
+};
+
+struct apk_verdict_header {
+    u32 magic;
+    u32 version;
+    u32 keys_hash;
+    u32 count;
 };
 
-static struct list_head apk_path_hash_list = LIST_HEAD_INIT(apk_path_hash_list);
+struct apk_verdict {
+    struct hlist_node node;
+    struct apk_key key;
+    bool seen;
+};
+
+#define APK_VERDICT_BITS 8
+static DEFINE_HASHTABLE(apk_verdicts, APK_VERDICT_BITS);
+static unsigned int apk_verdict_count;
+static bool apk_verdicts_dirty;
+
+static u64 apk_key_hash(const struct apk_key *key)
+{
+    return key->ino ^ ((u64)key->dev << 32);
+}
+
+static int apk_key_get(const char *path, struct apk_key *key)
+{
+    struct path kpath;
+    struct kstat stat;
+    int err;
+
+    err = kern_path(path, 0, &kpath);
+    if (err)
+        return err;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+    err = vfs_getattr(&kpath, &stat, STATX_BASIC_STATS, AT_STATX_SYNC_AS_STAT);
+#else
+    err = vfs_getattr(&kpath, &stat);
+#endif
+    path_put(&kpath);
+    if (err)
+        return err;
+
+    memset(key, 0, sizeof(*key));
+    key->ino = stat.ino;
+    key->size = stat.size;
+    key->mtime_sec = stat.mtime.tv_sec;
+    key->mtime_nsec = stat.mtime.tv_nsec;
+    key->dev = new_encode_dev(stat.dev);
+    return 0;
+}
+
+static struct apk_verdict *apk_verdict_find(const struct apk_key *key)
+{
+    struct apk_verdict *v;
+
+    hash_for_each_possible (apk_verdicts, v, node, apk_key_hash(key)) {
+        if (!memcmp(&v->key, key, sizeof(*key)))
+            return v;
+    }
+    return NULL;
+}
+
+static void apk_verdict_add(const struct apk_key *key)
+{
+    struct apk_verdict *v;
+
+    if (apk_verdict_count >= APK_VERDICT_MAX)
+        return;
+
+    v = kzalloc(sizeof(*v), GFP_KERNEL);
+    if (!v)
+        return;
+
+    v->key = *key;
+    v->seen = true;
+    hash_add(apk_verdicts, &v->node, apk_key_hash(key));
+    apk_verdict_count++;
+    apk_verdicts_dirty = true;
+}
+
+static void apk_verdicts_clear(void)
+{
+    struct apk_verdict *v;
+    struct hlist_node *tmp;
+    int bkt;
+
+    hash_for_each_safe (apk_verdicts, bkt, tmp, v, node) {
+        hash_del(&v->node);
+        kfree(v);
+    }
+    apk_verdict_count = 0;
+}
+
+static void do_save_apk_verdicts(struct callback_head *cb)
+{
+    struct apk_verdict_header *hdr = (struct apk_verdict_header *)(cb + 1);
+    size_t len = sizeof(*hdr) + hdr->count * sizeof(struct apk_key);
+    loff_t off = 0;
+    struct file *fp;
+
+    fp = filp_open(APK_VERDICT_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (IS_ERR(fp)) {
+        pr_err("save apk verdicts create file failed: %ld\n", PTR_ERR(fp));
+        goto out;
+    }
+
+    if (kernel_write(fp, hdr, len, &off) != len)
+        pr_err("save apk verdicts write failed\n");
+
+    filp_close(fp, 0);
+out:
+    kfree(cb);
+}
+
+// Snapshot the cache and write it out from init, like the allowlist
+static void save_apk_verdicts(void)
+{
+    struct apk_verdict_header *hdr;
+    struct apk_key *keys;
+    struct callback_head *cb;
+    struct task_struct *tsk;
+    struct apk_verdict *v;
+    int bkt;
+
+    cb = kzalloc(sizeof(*cb) + sizeof(*hdr) +
+                     apk_verdict_count * sizeof(struct apk_key),
+                 GFP_KERNEL);
+    if (!cb)
+        return;
+
+    hdr = (struct apk_verdict_header *)(cb + 1);
+    hdr->magic = APK_VERDICT_MAGIC;
+    hdr->version = APK_VERDICT_VERSION;
+    hdr->keys_hash = ksu_apk_sign_keys_hash();
+    keys = (struct apk_key *)(hdr + 1);
+    hash_for_each (apk_verdicts, bkt, v, node)
+        keys[hdr->count++] = v->key;
+
+    tsk = get_pid_task(find_vpid(1), PIDTYPE_PID);
+    if (!tsk) {
+        pr_err("save apk verdicts find init task err\n");
+        kfree(cb);
+        return;
+    }
+
+    cb->func = do_save_apk_verdicts;
+    if (task_work_add(tsk, cb, TWA_RESUME))
+        kfree(cb);
+    else
+        apk_verdicts_dirty = false;
+    put_task_struct(tsk);
+}
 
 struct my_dir_context {
     struct dir_context ctx;
     struct list_head *data_path_list;
     char *parent_dir;
-    void *private_data;
     int depth;
     int *stop;
 };
@@ -125,7 +351,7 @@ struct my_dir_context {
 #define FILLDIR_ACTOR_CONTINUE 0
 #define FILLDIR_ACTOR_STOP -EINVAL
 #endif
-extern bool is_manager_apk(char *path);
+extern int is_manager_apk(char *path);
 FILLDIR_RETURN_TYPE my_actor(struct dir_context *ctx, const char *name,
                              int namelen, loff_t off, u64 ino,
                              unsigned int d_type)
@@ -172,33 +398,26 @@ FILLDIR_RETURN_TYPE my_actor(struct dir_context *ctx, const char *name,
         list_add_tail(&data->list, my_ctx->data_path_list);
     } else {
         if ((namelen == 8) && (strncmp(name, "base.apk", namelen) == 0)) {
-            struct apk_path_hash *pos, *n;
-            unsigned int hash = full_name_hash(NULL, dirpath, strlen(dirpath));
-            list_for_each_entry (pos, &apk_path_hash_list, list) {
-                if (hash == pos->hash) {
-                    pos->exists = true;
+            struct apk_key key;
+            bool have_key = !apk_key_get(dirpath, &key);
+
+            if (have_key) {
+                struct apk_verdict *v = apk_verdict_find(&key);
+                if (v) {
+                    v->seen = true;
                     return FILLDIR_ACTOR_CONTINUE;
                 }
             }
 
-            bool is_manager = is_manager_apk(dirpath);
+            int is_manager = is_manager_apk(dirpath);
             pr_info("Found new base.apk at path: %s, is_manager: %d\n", dirpath,
                     is_manager);
-            if (is_manager) {
-                crown_manager(dirpath, my_ctx->private_data);
+            if (is_manager > 0) {
+                crown_manager(dirpath);
                 *my_ctx->stop = 1;
-
-                // Manager found, clear APK cache list
-                list_for_each_entry_safe (pos, n, &apk_path_hash_list, list) {
-                    list_del(&pos->list);
-                    kfree(pos);
-                }
-            } else {
-                struct apk_path_hash *apk_data =
-                    kzalloc(sizeof(struct apk_path_hash), GFP_ATOMIC);
-                apk_data->hash = hash;
-                apk_data->exists = true;
-                list_add_tail(&apk_data->list, &apk_path_hash_list);
+            } else if (!is_manager && have_key) {
+                // only a definite verdict, a failed check is retried
+                apk_verdict_add(&key);
             }
         }
     }
@@ -206,17 +425,19 @@ FILLDIR_RETURN_TYPE my_actor(struct dir_context *ctx, const char *name,
     return FILLDIR_ACTOR_CONTINUE;
 }
 
-void search_manager(const char *path, int depth, struct list_head *uid_data)
+void search_manager(const char *path, int depth)
 {
     int i, stop = 0;
     struct list_head data_path_list;
     INIT_LIST_HEAD(&data_path_list);
     unsigned long data_app_magic = 0;
 
-    // Initialize APK cache list
-    struct apk_path_hash *pos, *n;
-    list_for_each_entry (pos, &apk_path_hash_list, list) {
-        pos->exists = false;
+    // Initialize APK verdict cache
+    struct apk_verdict *v;
+    struct hlist_node *tmp;
+    int bkt;
+    hash_for_each (apk_verdicts, bkt, v, node) {
+        v->seen = false;
     }
 
     // First depth
@@ -232,7 +453,6 @@ void search_manager(const char *path, int depth, struct list_head *uid_data)
             struct my_dir_context ctx = { .ctx.actor = my_actor,
                                           .data_path_list = &data_path_list,
                                           .parent_dir = pos->dirpath,
-                                          .private_data = uid_data,
                                           .depth = pos->depth,
                                           .stop = &stop };
             struct file *file;
@@ -275,128 +495,318 @@ void search_manager(const char *path, int depth, struct list_head *uid_data)
         }
     }
 
-    // Remove stale cached APK entries
-    list_for_each_entry_safe (pos, n, &apk_path_hash_list, list) {
-        if (!pos->exists) {
-            list_del(&pos->list);
-            kfree(pos);
+    // Remove stale cached APK entries, unless the search stopped early
+    if (!stop) {
+        hash_for_each_safe (apk_verdicts, bkt, tmp, v, node) {
+            if (!v->seen) {
+                hash_del(&v->node);
+                kfree(v);
+                apk_verdict_count--;
+                apk_verdicts_dirty = true;
+            }
         }
     }
+
+    if (apk_verdicts_dirty)
+        save_apk_verdicts();
 }
 
-static bool is_uid_exist(uid_t uid, char *package, void *data)
+void ksu_throne_tracker_load_cache(void)
 {
-    struct list_head *list = (struct list_head *)data;
-    struct uid_data *np;
+    struct apk_verdict_header hdr;
+    struct apk_key key;
+    struct file *fp;
+    loff_t off = 0;
+    u32 i;
 
-    bool exist = false;
-    list_for_each_entry (np, list, list) {
-        if (np->uid == uid % PER_USER_RANGE &&
-            strncmp(np->package, package, KSU_MAX_PACKAGE_NAME) == 0) {
-            exist = true;
+    fp = filp_open(APK_VERDICT_PATH, O_RDONLY, 0);
+    if (IS_ERR(fp)) {
+        pr_info("no apk verdict cache: %ld\n", PTR_ERR(fp));
+        return;
+    }
+
+    if (kernel_read(fp, &hdr, sizeof(hdr), &off) != sizeof(hdr) ||
+        hdr.magic != APK_VERDICT_MAGIC || hdr.version != APK_VERDICT_VERSION) {
+        pr_err("apk verdict cache invalid\n");
+        goto out;
+    }
+
+    // computed against other manager keys, don't trust it
+    if (hdr.keys_hash != ksu_apk_sign_keys_hash()) {
+        pr_info("apk verdict cache is for other keys, ignored\n");
+        goto out;
+    }
+
+    mutex_lock(&throne_lock);
+    for (i = 0; i < hdr.count && i < APK_VERDICT_MAX; i++) {
+        if (kernel_read(fp, &key, sizeof(key), &off) != sizeof(key))
             break;
-        }
+        if (!apk_verdict_find(&key))
+            apk_verdict_add(&key);
     }
-    return exist;
+    apk_verdicts_dirty = false;
+    mutex_unlock(&throne_lock);
+
+    pr_info("loaded %u apk verdicts\n", apk_verdict_count);
+out:
+    filp_close(fp, 0);
 }
 
-void track_throne(bool prune_only)
+static bool is_uid_exist(uid_t uid, char *package, void *data)
 {
-    struct file *fp = filp_open(SYSTEM_PACKAGES_LIST_PATH, O_RDONLY, 0);
-    if (IS_ERR(fp)) {
-        pr_err("%s: open " SYSTEM_PACKAGES_LIST_PATH " failed: %ld\n", __func__,
-               PTR_ERR(fp));
-        return;
+    return uid_index_find(uid % PER_USER_RANGE, package) != NULL;
+}
+
+static int digest_packages_line(char *line, void *data)
+{
+    u32 *digest = data;
+
+    *digest = jhash(line, strlen(line), *digest);
+    return 0;
+}
+
+// Parse one "<package> <uid> ..." line, only the first two fields matter.
+// A malformed line is skipped rather than ending the scan, which would make
+// every package after it look removed.
+static int index_packages_line(char *line, void *data)
+{
+    unsigned int *added = data;
+    char *tmp = line;
+    const char *delim = " ";
+    char *package = strsep(&tmp, delim);
+    char *uid = strsep(&tmp, delim);
+    struct uid_data *np;
+    u32 res;
+
+    if (!uid || !package) {
+        pr_err("update_uid: package or uid is NULL!\n");
+        return 0;
     }
 
-    struct list_head uid_list;
-    INIT_LIST_HEAD(&uid_list);
+    if (kstrtou32(uid, 10, &res)) {
+        pr_err("update_uid: uid parse err\n");
+        return 0;
+    }
+
+    np = uid_index_find(res, package);
+    if (np) {
+        np->gen = uid_index_gen;
+        return 0;
+    }
 
-    char chr = 0;
+    np = kzalloc(sizeof(struct uid_data), GFP_KERNEL);
+    if (!np)
+        return -ENOMEM;
+
+    np->uid = res;
+    np->gen = uid_index_gen;
+    strncpy(np->package, package, KSU_MAX_PACKAGE_NAME - 1);
+    hash_add(uid_index, &np->node, np->uid);
+    (*added)++;
+    return 0;
+}
+
+// Read packages.list a page at a time and split lines in memory. Lines are
+// cut at KSU_MAX_PACKAGE_NAME, which leaves plenty for package and uid, and
+// a trailing line without newline is ignored, as it may still be written.
+static int read_packages_list(struct file *fp,
+                              int (*fn)(char *line, void *data), void *data)
+{
+    char line[KSU_MAX_PACKAGE_NAME];
+    size_t line_len = 0;
     loff_t pos = 0;
-    loff_t line_start = 0;
-    char buf[KSU_MAX_PACKAGE_NAME];
+    char *chunk;
+    int ret = 0;
+
+    chunk = kmalloc(PAGE_SIZE, GFP_KERNEL);
+    if (!chunk)
+        return -ENOMEM;
+
     for (;;) {
-        ssize_t count = kernel_read(fp, &chr, sizeof(chr), &pos);
-        if (count != sizeof(chr))
+        ssize_t count = kernel_read(fp, chunk, PAGE_SIZE, &pos);
+        char *p = chunk, *end;
+
+        if (count <= 0)
             break;
-        if (chr != '\n')
-            continue;
+        end = chunk + count;
 
-        count = kernel_read(fp, buf, sizeof(buf), &line_start);
+        while (p < end) {
+            char *nl = memchr(p, '\n', end - p);
+            size_t len = (nl ? nl : end) - p;
+            size_t room = sizeof(line) - 1 - line_len;
 
-        struct uid_data *data = kzalloc(sizeof(struct uid_data), GFP_ATOMIC);
-        if (!data) {
-            filp_close(fp, 0);
-            goto out;
-        }
+            memcpy(line + line_len, p, min(len, room));
+            line_len += min(len, room);
 
-        char *tmp = buf;
-        const char *delim = " ";
-        char *package = strsep(&tmp, delim);
-        char *uid = strsep(&tmp, delim);
-        if (!uid || !package) {
-            pr_err("update_uid: package or uid is NULL!\n");
-            break;
-        }
+            if (!nl)
+                break;
 
-        u32 res;
-        if (kstrtou32(uid, 10, &res)) {
-            pr_err("update_uid: uid parse err\n");
-            break;
+            line[line_len] = '\0';
+            line_len = 0;
+            p = nl + 1;
+
+            ret = fn(line, data);
+            if (ret)
+                goto out;
         }
-        data->uid = res;
-        strncpy(data->package, package, KSU_MAX_PACKAGE_NAME);
-        list_add_tail(&data->list, &uid_list);
-        // reset line start
-        line_start = pos;
     }
-    filp_close(fp, 0);
 
-    // now update uid list
+out:
+    kfree(chunk);
+    return ret;
+}
+
+// Bring the index up to date, returns the number of uids that disappeared
+static int update_uid_index(struct file *fp)
+{
+    unsigned int added = 0, removed = 0;
     struct uid_data *np;
-    struct uid_data *n;
+    struct hlist_node *tmp;
+    u32 digest = 0;
+    int bkt, err;
+
+    err = read_packages_list(fp, digest_packages_line, &digest);
+    if (err)
+        return err;
+
+    if (packages_list_indexed && digest == packages_list_digest)
+        return 0;
+
+    uid_index_gen++;
+    err = read_packages_list(fp, index_packages_line, &added);
+    if (err) {
+        // half applied, don't prune on it and rescan everything next time
+        packages_list_indexed = false;
+        return err;
+    }
+
+    hash_for_each_safe (uid_index, bkt, tmp, np, node) {
+        if (np->gen != uid_index_gen) {
+            hash_del(&np->node);
+            kfree(np);
+            removed++;
+        }
+    }
+
+    packages_list_digest = digest;
+    packages_list_indexed = true;
+    pr_info("%s: %u packages added, %u removed\n", __func__, added, removed);
+
+    return removed;
+}
+
+void track_throne(bool prune_only)
+{
+    struct file *fp = filp_open(SYSTEM_PACKAGES_LIST_PATH, O_RDONLY, 0);
+    if (IS_ERR(fp)) {
+        pr_err("%s: open " SYSTEM_PACKAGES_LIST_PATH " failed: %ld\n", __func__,
+               PTR_ERR(fp));
+        return;
+    }
+
+    mutex_lock(&throne_lock);
+
+    int removed = update_uid_index(fp);
+    filp_close(fp, 0);
+    if (removed < 0)
+        goto out;
 
     if (prune_only)
         goto prune;
 
     // first, check if manager_uid exist!
-    bool manager_exist = false;
-    list_for_each_entry (np, &uid_list, list) {
-        if (np->uid == ksu_get_manager_appid()) {
-            manager_exist = true;
-            break;
-        }
-    }
-
-    if (!manager_exist) {
+    if (!uid_index_has_uid(ksu_get_manager_appid())) {
         if (ksu_is_manager_appid_valid()) {
             pr_info("manager is uninstalled, invalidate it!\n");
             ksu_invalidate_manager_uid();
             goto prune;
         }
         pr_info("Searching manager...\n");
-        search_manager("/data/app", 2, &uid_list);
+        search_manager("/data/app", 2);
         pr_info("Search manager finished\n");
     }
 
+    // nothing disappeared, nothing to prune
+    if (!removed)
+        goto out;
+
 prune:
     // then prune the allowlist
-    ksu_prune_allowlist(is_uid_exist, &uid_list);
+    ksu_prune_allowlist(is_uid_exist, NULL);
 out:
-    // free uid_list
-    list_for_each_entry_safe (np, n, &uid_list, list) {
-        list_del(&np->list);
-        kfree(np);
+    mutex_unlock(&throne_lock);
+}
+
+/*
+ * PackageManager rewrites packages.list through a temp file and a rename,
+ * often several times in a row while installing. Events are coalesced into
+ * one rescan once they have been quiet for throne_debounce_ms; a steady
+ * stream of them delays the rescan by at most THRONE_MAX_DEFER windows.
+ */
+static unsigned int throne_debounce_ms = 500;
+module_param(throne_debounce_ms, uint, 0644);
+MODULE_PARM_DESC(throne_debounce_ms,
+                 "Quiet time before packages.list changes are rescanned");
+
+#define THRONE_MAX_DEFER 4
+
+static struct workqueue_struct *throne_wq;
+static unsigned long throne_first_request;
+
+// The kworker runs in the kernel domain, which can't read packages.list or
+// walk /data/app; borrow the ksu domain like the umount task work does.
+static void throne_work_func(struct work_struct *work)
+{
+    const struct cred *saved;
+
+    if (!ksu_cred) {
+        track_throne(false);
+        return;
     }
+
+    saved = override_creds(ksu_cred);
+    track_throne(false);
+    revert_creds(saved);
+}
+
+static DECLARE_DELAYED_WORK(throne_work, throne_work_func);
+
+void ksu_request_track_throne(void)
+{
+    unsigned long delay = msecs_to_jiffies(READ_ONCE(throne_debounce_ms));
+
+    if (unlikely(!throne_wq)) {
+        track_throne(false);
+        return;
+    }
+
+    if (!delayed_work_pending(&throne_work))
+        throne_first_request = jiffies;
+
+    if (time_before(jiffies,
+                    throne_first_request + THRONE_MAX_DEFER * delay))
+        mod_delayed_work(throne_wq, &throne_work, delay);
+    else
+        queue_delayed_work(throne_wq, &throne_work, delay);
 }
 
 void ksu_throne_tracker_init()
 {
-    // nothing to do
+    throne_wq = alloc_ordered_workqueue("ksu_throne", 0);
+    if (!throne_wq)
+        pr_err("Failed to create throne workqueue, tracking synchronously\n");
 }
 
 void ksu_throne_tracker_exit()
 {
-    // nothing to do
+    if (throne_wq) {
+        cancel_delayed_work_sync(&throne_work);
+        destroy_workqueue(throne_wq);
+        throne_wq = NULL;
+    }
+
+    mutex_lock(&throne_lock);
+    uid_index_clear();
+    apk_verdicts_clear();
+    mutex_unlock(&throne_lock);
 }
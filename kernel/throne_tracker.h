@@ -7,4 +7,10 @@ void ksu_throne_tracker_exit();
 
 void track_throne(bool prune_only);
 
+// Load the saved apk verdicts, once /data is available
+void ksu_throne_tracker_load_cache(void);
+
+// Debounced track_throne(false) on the throne workqueue
+void ksu_request_track_throne(void);
+
 #endif
@@ -0,0 +1,637 @@
+// Host harness and microbenchmark for the manager APK verifier.
+//
+// Builds kernel/apk_sign.c against the shims in ksu_host.h, writes a corpus
+// of synthetic APKs, checks the verdict for each of them and reports the
+// time and number of kernel_read calls per is_manager_apk call. It also
+// checks that failed reads, opens or sha256 lookups come back as errors,
+// which the throne tracker doesn't cache, rather than as "not manager".
+// Exits with 1 when a verdict is wrong, so it can run in CI on any Linux
+// host.
+//
+// Build: make -C kernel apk_sign_bench
+// Usage: ./apk_sign_bench [-i iterations] [-d dir] [-k] [apk...]
+//
+// With APK paths it only reports the verdict and timing for those files.
+
+// The synthetic manager certificate, see make_cert()
+#define EXPECTED_SIZE 0x300
+#define EXPECTED_HASH                                                          \
+    "f696a01d4d2b65565dbd0ec69aeb8ed6fa2299590532afc0222540e60c194633"
+
+#include "../../apk_sign.c"
+
+#include <stdio.h>
+#include <time.h>
+
+unsigned long ksu_host_reads;
+bool ksu_host_fail_reads;
+static bool ksu_host_fail_tfm;
+
+// sha256
+
+struct sha256_ctx {
+    u32 state[8];
+    u64 len;
+    u8 buf[64];
+    size_t buf_len;
+};
+
+static const u32 sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(struct sha256_ctx *ctx, const u8 *p)
+{
+    u32 w[64], a, b, c, d, e, f, g, h;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        w[i] = (u32)p[i * 4] << 24 | p[i * 4 + 1] << 16 | p[i * 4 + 2] << 8 |
+               p[i * 4 + 3];
+    for (; i < 64; i++) {
+        u32 s0 = ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        u32 s1 = ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a = ctx->state[0];
+    b = ctx->state[1];
+    c = ctx->state[2];
+    d = ctx->state[3];
+    e = ctx->state[4];
+    f = ctx->state[5];
+    g = ctx->state[6];
+    h = ctx->state[7];
+
+    for (i = 0; i < 64; i++) {
+        u32 s1 = ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25);
+        u32 t1 = h + s1 + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        u32 s0 = ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22);
+        u32 t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
+
+static void sha256(const u8 *data, size_t len, u8 *out)
+{
+    struct sha256_ctx ctx = {
+        .state = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f,
+                   0x9b05688c, 0x1f83d9ab, 0x5be0cd19 },
+    };
+    u64 bits = (u64)len * 8;
+    int i;
+
+    for (; len >= 64; data += 64, len -= 64)
+        sha256_block(&ctx, data);
+
+    memcpy(ctx.buf, data, len);
+    ctx.buf[len++] = 0x80;
+    if (len > 56) {
+        memset(ctx.buf + len, 0, 64 - len);
+        sha256_block(&ctx, ctx.buf);
+        len = 0;
+    }
+    memset(ctx.buf + len, 0, 56 - len);
+    for (i = 0; i < 8; i++)
+        ctx.buf[56 + i] = bits >> (56 - i * 8);
+    sha256_block(&ctx, ctx.buf);
+
+    for (i = 0; i < 8; i++) {
+        out[i * 4] = ctx.state[i] >> 24;
+        out[i * 4 + 1] = ctx.state[i] >> 16;
+        out[i * 4 + 2] = ctx.state[i] >> 8;
+        out[i * 4 + 3] = ctx.state[i];
+    }
+}
+
+struct crypto_shash *crypto_alloc_shash(const char *name, u32 type, u32 mask)
+{
+    static struct crypto_shash tfm;
+
+    (void)type;
+    (void)mask;
+    // like sha256 living in a module that isn't loaded yet
+    if (ksu_host_fail_tfm || strcmp(name, "sha256"))
+        return ERR_PTR(-ENOENT);
+    return &tfm;
+}
+
+void crypto_free_shash(struct crypto_shash *tfm)
+{
+    (void)tfm;
+}
+
+int crypto_shash_digest(struct shash_desc *desc, const u8 *data,
+                        unsigned int len, u8 *out)
+{
+    (void)desc;
+    sha256(data, len, out);
+    return 0;
+}
+
+// synthetic APKs
+
+struct buf {
+    u8 *p;
+    size_t len;
+    size_t cap;
+};
+
+static void put(struct buf *b, const void *data, size_t len)
+{
+    if (b->len + len > b->cap) {
+        b->cap = (b->len + len) * 2;
+        b->p = realloc(b->p, b->cap);
+        if (!b->p) {
+            perror("realloc");
+            exit(2);
+        }
+    }
+    if (data)
+        memcpy(b->p + b->len, data, len);
+    else
+        memset(b->p + b->len, 0, len);
+    b->len += len;
+}
+
+static void put16(struct buf *b, u16 v)
+{
+    u8 le[2] = { v, v >> 8 };
+    put(b, le, 2);
+}
+
+static void put32(struct buf *b, u32 v)
+{
+    u8 le[4] = { v, v >> 8, v >> 16, v >> 24 };
+    put(b, le, 4);
+}
+
+static void put64(struct buf *b, u64 v)
+{
+    put32(b, v);
+    put32(b, v >> 32);
+}
+
+// Start a u32 length-prefixed region, finish it with lp_end()
+static size_t lp_begin(struct buf *b)
+{
+    put32(b, 0);
+    return b->len;
+}
+
+static void lp_end(struct buf *b, size_t start)
+{
+    u32 len = b->len - start;
+    u8 le[4] = { len, len >> 8, len >> 16, len >> 24 };
+    memcpy(b->p + start - 4, le, 4);
+}
+
+static void make_cert(u8 *cert, size_t len, bool wrong)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        cert[i] = i * 31 + 7;
+    if (wrong)
+        cert[len / 2] ^= 0xff;
+}
+
+struct apk_spec {
+    const char *name;
+    int expected;
+    bool v2;
+    bool v3;
+    bool wrong_cert;
+    u32 cert_size;
+    bool v1_manifest;
+    bool data_descriptor;
+    bool bad_signer_len;
+    size_t payload;
+    size_t comment;
+    int truncate_pct;
+};
+
+static void put_v2_block(struct buf *b, const struct apk_spec *spec)
+{
+    u32 cert_size = spec->cert_size ? spec->cert_size : EXPECTED_SIZE;
+    u8 *cert = malloc(cert_size);
+    size_t seq, signer, signed_data, digests, digest, certs, one, attrs;
+
+    make_cert(cert, cert_size, spec->wrong_cert);
+
+    seq = lp_begin(b);
+    signer = lp_begin(b);
+    signed_data = lp_begin(b);
+
+    digests = lp_begin(b);
+    digest = lp_begin(b);
+    put32(b, 0x0103); // RSASSA-PKCS1-v1_5 with SHA2-256
+    one = lp_begin(b);
+    put(b, NULL, 32);
+    lp_end(b, one);
+    lp_end(b, digest);
+    lp_end(b, digests);
+
+    certs = lp_begin(b);
+    one = lp_begin(b);
+    put(b, cert, cert_size);
+    lp_end(b, one);
+    lp_end(b, certs);
+
+    attrs = lp_begin(b);
+    lp_end(b, attrs);
+
+    lp_end(b, signed_data);
+
+    one = lp_begin(b); // signatures
+    lp_end(b, one);
+    one = lp_begin(b); // public key
+    put(b, NULL, 64);
+    lp_end(b, one);
+
+    lp_end(b, signer);
+    lp_end(b, seq);
+
+    if (spec->bad_signer_len) {
+        // signer claims more than the sequence holds
+        u32 huge = 0x7fffffff;
+        memcpy(b->p + signer - 4, &huge, 4);
+    }
+
+    free(cert);
+}
+
+static void put_signing_block(struct buf *b, const struct apk_spec *spec)
+{
+    struct buf pairs = { 0 };
+    u64 size;
+
+    if (spec->v2) {
+        struct buf value = { 0 };
+
+        put_v2_block(&value, spec);
+        put64(&pairs, value.len + 4);
+        put32(&pairs, APK_SIG_V2_ID);
+        put(&pairs, value.p, value.len);
+        free(value.p);
+    }
+    if (spec->v3) {
+        struct buf value = { 0 };
+
+        put_v2_block(&value, spec);
+        put64(&pairs, value.len + 4);
+        put32(&pairs, APK_SIG_V3_ID);
+        put(&pairs, value.p, value.len);
+        free(value.p);
+    }
+
+    // the size counts everything but itself: pairs, the size copy, magic
+    size = pairs.len + 8 + 16;
+    put64(b, size);
+    put(b, pairs.p, pairs.len);
+    put64(b, size);
+    put(b, APK_SIG_BLOCK_MAGIC, 16);
+    free(pairs.p);
+}
+
+struct zip_entry {
+    const char *name;
+    size_t size;
+    u32 offset;
+    bool dd;
+};
+
+static void put_local(struct buf *b, struct zip_entry *e)
+{
+    u8 *data = calloc(1, e->size ? e->size : 1);
+
+    e->offset = b->len;
+    put32(b, 0x04034b50);
+    put16(b, 20);
+    put16(b, e->dd ? 0x08 : 0); // bit 3: sizes in a data descriptor
+    put16(b, 0); // stored
+    put16(b, 0);
+    put16(b, 0);
+    put32(b, 0); // crc, nobody checks it here
+    put32(b, e->dd ? 0 : e->size);
+    put32(b, e->dd ? 0 : e->size);
+    put16(b, strlen(e->name));
+    put16(b, 0);
+    put(b, e->name, strlen(e->name));
+    put(b, data, e->size);
+    if (e->dd) {
+        put32(b, 0x08074b50);
+        put32(b, 0);
+        put32(b, e->size);
+        put32(b, e->size);
+    }
+    free(data);
+}
+
+static void put_central(struct buf *b, const struct zip_entry *e)
+{
+    put32(b, ZIP_CD_MAGIC);
+    put16(b, 20);
+    put16(b, 20);
+    put16(b, e->dd ? 0x08 : 0);
+    put16(b, 0);
+    put16(b, 0);
+    put16(b, 0);
+    put32(b, 0);
+    put32(b, e->size);
+    put32(b, e->size);
+    put16(b, strlen(e->name));
+    put16(b, 0);
+    put16(b, 0);
+    put16(b, 0);
+    put16(b, 0);
+    put32(b, 0);
+    put32(b, e->offset);
+    put(b, e->name, strlen(e->name));
+}
+
+static int write_apk(const char *path, const struct apk_spec *spec)
+{
+    struct zip_entry entries[3] = {
+        { .name = "AndroidManifest.xml", .size = 512 },
+        { .name = "classes.dex", .size = spec->payload },
+        { .name = "META-INF/MANIFEST.MF",
+          .size = 128,
+          .dd = spec->data_descriptor },
+    };
+    int nr = spec->v1_manifest ? 3 : 2;
+    struct buf b = { 0 };
+    u32 cd_offset, cd_size;
+    size_t len;
+    FILE *fp;
+    int i;
+
+    // a streaming writer puts the manifest first, with a data descriptor
+    if (spec->v1_manifest && spec->data_descriptor)
+        put_local(&b, &entries[2]);
+    for (i = 0; i < 2; i++)
+        put_local(&b, &entries[i]);
+    if (spec->v1_manifest && !spec->data_descriptor)
+        put_local(&b, &entries[2]);
+
+    if (spec->v2 || spec->v3)
+        put_signing_block(&b, spec);
+
+    cd_offset = b.len;
+    for (i = 0; i < nr; i++)
+        put_central(&b, &entries[i]);
+    cd_size = b.len - cd_offset;
+
+    put32(&b, APK_EOCD_MAGIC);
+    put16(&b, 0);
+    put16(&b, 0);
+    put16(&b, nr);
+    put16(&b, nr);
+    put32(&b, cd_size);
+    put32(&b, cd_offset);
+    put16(&b, spec->comment);
+    put(&b, NULL, spec->comment);
+
+    len = b.len;
+    if (spec->truncate_pct)
+        len = len * spec->truncate_pct / 100;
+
+    fp = fopen(path, "wb");
+    if (!fp || fwrite(b.p, 1, len, fp) != len) {
+        perror(path);
+        free(b.p);
+        if (fp)
+            fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    free(b.p);
+    return 0;
+}
+
+static const struct apk_spec corpus[] = {
+    { .name = "manager", .expected = 1, .v2 = true },
+    { .name = "wrong_cert", .expected = 0, .v2 = true, .wrong_cert = true },
+    { .name = "wrong_size", .expected = 0, .v2 = true, .cert_size = 0x301 },
+    { .name = "v3_only", .expected = 0, .v3 = true },
+    { .name = "v2_v3", .expected = 0, .v2 = true, .v3 = true },
+    { .name = "v1_manifest", .expected = 0, .v2 = true, .v1_manifest = true },
+    { .name = "v1_streamed",
+      .expected = 0,
+      .v2 = true,
+      .v1_manifest = true,
+      .data_descriptor = true },
+    { .name = "unsigned", .expected = 0 },
+    { .name = "bad_signer", .expected = 0, .v2 = true, .bad_signer_len = true },
+    { .name = "truncated", .expected = 0, .v2 = true, .truncate_pct = 60 },
+    { .name = "huge_comment", .expected = 1, .v2 = true, .comment = 0xffff },
+    { .name = "large_payload",
+      .expected = 1,
+      .v2 = true,
+      .payload = 64 << 20 },
+};
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Returns the verdict, fills in the mean time and reads per call
+static int bench_one(const char *path, int iterations, double *us,
+                     double *reads)
+{
+    unsigned long reads_before = ksu_host_reads;
+    double start = now_us();
+    int verdict = 0;
+    int i;
+
+    for (i = 0; i < iterations; i++)
+        verdict = is_manager_apk((char *)path);
+
+    *us = (now_us() - start) / iterations;
+    *reads = (double)(ksu_host_reads - reads_before) / iterations;
+    return verdict;
+}
+
+static int check_fault(const char *name, const char *path, bool *fail)
+{
+    int verdict;
+
+    if (fail)
+        *fail = true;
+    verdict = is_manager_apk((char *)path);
+    if (fail)
+        *fail = false;
+
+    printf("%-16s %10s %8d %10s %10s%s\n", name, "-", verdict, "-", "-",
+           verdict < 0 ? "" : "  WRONG");
+    return verdict < 0;
+}
+
+// A failed check must not pass for a verdict: the throne tracker would
+// remember the manager APK as "not manager" and never crown it. Runs before
+// anything else, so the sha256 transform hasn't been set up yet.
+static int check_faults(const char *dir)
+{
+    char path[512], missing[512];
+    int failed = 0;
+
+    snprintf(path, sizeof(path), "%s/fault.apk", dir);
+    snprintf(missing, sizeof(missing), "%s/missing.apk", dir);
+    // corpus[0] is the manager
+    if (write_apk(path, &corpus[0]))
+        return 1;
+
+    failed += !check_fault("fault_sha256", path, &ksu_host_fail_tfm);
+    failed += !check_fault("fault_read", path, &ksu_host_fail_reads);
+    failed += !check_fault("fault_open", missing, NULL);
+
+    // and none of them stuck
+    if (is_manager_apk(path) != 1) {
+        printf("%-16s verdict after faults is wrong\n", "fault.apk");
+        failed++;
+    }
+
+    unlink(path);
+    return failed;
+}
+
+static long file_size(const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) ? -1 : st.st_size;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-i iterations] [-d dir] [-k] [apk...]\n"
+            "  -i  calls per APK (default 200)\n"
+            "  -d  where to write the corpus (default: a new /tmp dir)\n"
+            "  -k  keep the corpus\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    char tmpl[] = "/tmp/apk_sign_bench.XXXXXX";
+    const char *dir = NULL;
+    int iterations = 200;
+    bool keep = false;
+    int opt, failed = 0;
+    size_t i;
+
+    while ((opt = getopt(argc, argv, "i:d:kh")) != -1) {
+        switch (opt) {
+        case 'i':
+            iterations = atoi(optarg);
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        case 'k':
+            keep = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    if (iterations <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    printf("%-16s %10s %8s %10s %10s\n", "apk", "bytes", "verdict", "us/call",
+           "reads/call");
+
+    if (optind < argc) {
+        for (; optind < argc; optind++) {
+            double us, reads;
+            int verdict = bench_one(argv[optind], iterations, &us, &reads);
+
+            printf("%-16s %10ld %8d %10.2f %10.1f\n", argv[optind],
+                   file_size(argv[optind]), verdict, us, reads);
+        }
+        ksu_apk_sign_exit();
+        return 0;
+    }
+
+    if (!dir) {
+        dir = mkdtemp(tmpl);
+        if (!dir) {
+            perror("mkdtemp");
+            return 2;
+        }
+    }
+
+    failed += check_faults(dir);
+
+    for (i = 0; i < ARRAY_SIZE(corpus); i++) {
+        const struct apk_spec *spec = &corpus[i];
+        char path[512];
+        double us, reads;
+        int verdict;
+
+        snprintf(path, sizeof(path), "%s/%s.apk", dir, spec->name);
+        if (write_apk(path, spec))
+            return 2;
+
+        verdict = bench_one(path, iterations, &us, &reads);
+        printf("%-16s %10ld %8d %10.2f %10.1f%s\n", spec->name,
+               file_size(path), verdict, us, reads,
+               verdict == spec->expected ? "" : "  WRONG");
+        if (verdict != spec->expected)
+            failed++;
+
+        if (!keep)
+            unlink(path);
+    }
+
+    if (!keep)
+        rmdir(dir);
+    else
+        printf("corpus kept in %s\n", dir);
+
+    ksu_apk_sign_exit();
+
+    if (failed) {
+        printf("%d wrong verdicts\n", failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,2 @@
+// Stub for the host build of apk_sign.c, everything lives in ksu_host.h
+#include "../../ksu_host.h"
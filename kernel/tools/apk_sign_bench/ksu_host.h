@@ -0,0 +1,207 @@
+// Just enough of the kernel API to build apk_sign.c as a userspace program:
+// struct file over a plain fd, vmalloc over malloc, and a software sha256
+// behind the crypto_shash calls. Every kernel_read is counted, and reads
+// or the sha256 lookup can be made to fail.
+#ifndef __KSU_HOST_H
+#define __KSU_HOST_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int64_t s64;
+typedef int64_t loff_t;
+
+#define LINUX_VERSION_CODE KERNEL_VERSION(6, 12, 0)
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+
+#ifndef __always_inline
+#define __always_inline inline
+#endif
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define min_t(type, a, b) ((type)(a) < (type)(b) ? (type)(a) : (type)(b))
+
+static inline void ksu_host_log(const char *fmt, ...)
+{
+    // kernel format extensions like %*phN don't work here, stay quiet
+    (void)fmt;
+}
+#define pr_info(...) ksu_host_log(__VA_ARGS__)
+#define pr_err(...) ksu_host_log(__VA_ARGS__)
+
+// errors
+
+#define MAX_ERRNO 4095
+#define IS_ERR(ptr) ((unsigned long)(ptr) >= (unsigned long)-MAX_ERRNO)
+#define PTR_ERR(ptr) ((long)(ptr))
+#define ERR_PTR(err) ((void *)(long)(err))
+
+// memory
+
+#define GFP_KERNEL 0
+#define vmalloc(size) malloc(size)
+#define vfree(ptr) free(ptr)
+#define kmalloc(size, gfp) malloc(size)
+#define kfree(ptr) free(ptr)
+
+// files
+
+#define FMODE_NONOTIFY 0x4000000
+
+struct inode {
+    loff_t i_size;
+};
+
+struct file {
+    int fd;
+    unsigned int f_mode;
+    struct inode f_inode;
+};
+
+extern unsigned long ksu_host_reads;
+extern bool ksu_host_fail_reads;
+
+static inline struct file *filp_open(const char *path, int flags, int mode)
+{
+    struct file *fp;
+    struct stat st;
+    int fd = open(path, flags, mode);
+
+    if (fd < 0)
+        return ERR_PTR(-errno);
+    if (fstat(fd, &st)) {
+        close(fd);
+        return ERR_PTR(-EIO);
+    }
+
+    fp = calloc(1, sizeof(*fp));
+    if (!fp) {
+        close(fd);
+        return ERR_PTR(-ENOMEM);
+    }
+    fp->fd = fd;
+    fp->f_inode.i_size = st.st_size;
+    return fp;
+}
+
+static inline int filp_close(struct file *fp, void *id)
+{
+    (void)id;
+    close(fp->fd);
+    free(fp);
+    return 0;
+}
+
+static inline ssize_t kernel_read(struct file *fp, void *buf, size_t count,
+                                  loff_t *pos)
+{
+    ssize_t ret;
+
+    ksu_host_reads++;
+    if (ksu_host_fail_reads)
+        return -EIO;
+    ret = pread(fp->fd, buf, count, *pos);
+    if (ret > 0)
+        *pos += ret;
+    return ret;
+}
+
+#define file_inode(fp) (&(fp)->f_inode)
+#define i_size_read(inode) ((inode)->i_size)
+
+// unaligned little endian access
+
+static inline u16 get_unaligned_le16(const void *p)
+{
+    const u8 *b = p;
+    return b[0] | b[1] << 8;
+}
+
+static inline u32 get_unaligned_le32(const void *p)
+{
+    const u8 *b = p;
+    return b[0] | b[1] << 8 | b[2] << 16 | (u32)b[3] << 24;
+}
+
+static inline u64 get_unaligned_le64(const void *p)
+{
+    return get_unaligned_le32(p) | (u64)get_unaligned_le32((const u8 *)p + 4)
+                                       << 32;
+}
+
+// locking, the host build is single threaded
+
+struct mutex {
+    int unused;
+};
+#define DEFINE_MUTEX(name) struct mutex name
+#define mutex_lock(m) ((void)(m))
+#define mutex_unlock(m) ((void)(m))
+#define smp_load_acquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+// strings and hashes
+
+static inline int hex2bin(u8 *dst, const char *src, size_t count)
+{
+    while (count--) {
+        unsigned int v;
+        char byte[3] = { src[0], src[1], 0 };
+        char *end;
+
+        v = strtoul(byte, &end, 16);
+        if (*end || !src[0] || !src[1])
+            return -EINVAL;
+        *dst++ = v;
+        src += 2;
+    }
+    return 0;
+}
+
+static inline u32 jhash(const void *key, u32 length, u32 initval)
+{
+    // FNV-1a, the host build only needs some stable hash
+    const u8 *p = key;
+    u32 hash = 2166136261u ^ initval;
+
+    while (length--)
+        hash = (hash ^ *p++) * 16777619u;
+    return hash;
+}
+
+// crypto_shash, sha256 only
+
+#define SHA256_DIGEST_SIZE 32
+
+struct crypto_shash {
+    int unused;
+};
+
+struct shash_desc {
+    struct crypto_shash *tfm;
+};
+
+#define SHASH_DESC_ON_STACK(desc, shash)                                       \
+    struct shash_desc __##desc##_storage = { 0 };                              \
+    struct shash_desc *desc = &__##desc##_storage
+
+struct crypto_shash *crypto_alloc_shash(const char *name, u32 type, u32 mask);
+void crypto_free_shash(struct crypto_shash *tfm);
+int crypto_shash_digest(struct shash_desc *desc, const u8 *data,
+                        unsigned int len, u8 *out);
+#define shash_desc_zero(desc) memset(desc, 0, sizeof(*(desc)))
+
+#endif
@@ -0,0 +1,2 @@
+// Stub for the host build of sulog.c, everything lives in ksu_host.h
+#include "../../ksu_host.h"
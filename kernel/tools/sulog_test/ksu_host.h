@@ -0,0 +1,290 @@
+// Just enough of the kernel API to build sulog.c as a userspace program:
+// one cpu, no preemption, work items that run as soon as they are queued,
+// and a small fd table for the anon inode files.
+#ifndef __KSU_HOST_H
+#define __KSU_HOST_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef uint8_t __u8;
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+typedef int32_t __s32;
+typedef int64_t loff_t;
+typedef unsigned int __poll_t;
+
+#define LINUX_VERSION_CODE KERNEL_VERSION(6, 12, 0)
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+
+#define __user
+#define __percpu
+#define __read_mostly
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define min_t(type, a, b) ((type)(a) < (type)(b) ? (type)(a) : (type)(b))
+
+#define PAGE_SIZE 4096UL
+#define PAGE_ALIGN(x) (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+#define NSEC_PER_SEC 1000000000ULL
+#define HZ 100
+#define TASK_COMM_LEN 16
+
+static inline void ksu_host_log(const char *fmt, ...)
+{
+    (void)fmt;
+}
+#define pr_info(...) ksu_host_log(__VA_ARGS__)
+#define pr_err(...) ksu_host_log(__VA_ARGS__)
+
+// errors
+
+#define MAX_ERRNO 4095
+#define IS_ERR(ptr) ((unsigned long)(ptr) >= (unsigned long)-MAX_ERRNO)
+#define PTR_ERR(ptr) ((long)(ptr))
+#define ERR_PTR(err) ((void *)(long)(err))
+
+// memory and barriers, the host build is single threaded
+
+#define vmalloc_user(size) calloc(1, size)
+#define vfree(ptr) free(ptr)
+
+#define READ_ONCE(x) (*(volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, v) (*(volatile __typeof__(x) *)&(x) = (v))
+#define smp_load_acquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define smp_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+
+#define preempt_disable() ((void)0)
+#define preempt_enable() ((void)0)
+#define synchronize_rcu() ((void)0)
+#define synchronize_sched() ((void)0)
+
+struct mutex {
+    int unused;
+};
+#define DEFINE_MUTEX(name) struct mutex name
+#define mutex_lock(m) ((void)(m))
+#define mutex_unlock(m) ((void)(m))
+
+// percpu, a single cpu
+
+#define alloc_percpu(type) ((type *)calloc(1, sizeof(type)))
+#define free_percpu(ptr) free(ptr)
+#define per_cpu_ptr(ptr, cpu) ((void)(cpu), (ptr))
+#define this_cpu_ptr(ptr) (ptr)
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < 1; (cpu)++)
+
+// tasks
+
+struct mm_struct;
+
+struct task_struct {
+    char comm[TASK_COMM_LEN];
+    pid_t pid;
+    struct mm_struct *mm;
+};
+
+extern struct task_struct ksu_host_current;
+#define current (&ksu_host_current)
+
+struct pid;
+#define PIDTYPE_PID 0
+// the consumer falls back to the comm captured at report time
+#define find_vpid(nr) ((void)(nr), (struct pid *)NULL)
+#define get_pid_task(pid, type) ((void)(pid), (struct task_struct *)NULL)
+#define put_task_struct(tsk) ((void)(tsk))
+#define get_cmdline(tsk, buf, len) 0
+
+struct cred;
+
+// time
+
+static inline u64 ktime_get_real_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+// work runs synchronously when it is queued, delayed work never runs
+
+struct work_struct {
+    void (*func)(struct work_struct *work);
+};
+
+struct delayed_work {
+    struct work_struct work;
+};
+
+#define DECLARE_WORK(name, fn) struct work_struct name = { .func = (fn) }
+#define DECLARE_DELAYED_WORK(name, fn)                                         \
+    struct delayed_work name = { .work = { .func = (fn) } }
+#define schedule_work(w) ((w)->func(w), true)
+#define schedule_delayed_work(w, delay) ((void)(w), (void)(delay), true)
+#define cancel_work_sync(w) ((void)(w), false)
+#define cancel_delayed_work_sync(w) ((void)(w), false)
+
+// wait queues and poll
+
+struct wait_queue_head {
+    int unused;
+};
+#define DECLARE_WAIT_QUEUE_HEAD(name) struct wait_queue_head name
+#define wake_up_interruptible(wq) ((void)(wq))
+// nothing can wake a sleeper on one thread, fail instead of hanging
+#define wait_event_interruptible(wq, cond) ((cond) ? 0 : -EINTR)
+
+typedef struct {
+    int unused;
+} poll_table;
+#define poll_wait(filp, wq, p) ((void)(p))
+#define EPOLLIN 0x1
+#define EPOLLRDNORM 0x40
+
+// files
+
+struct inode;
+struct file;
+
+struct vm_area_struct {
+    unsigned long vm_flags;
+    unsigned long vm_pgoff;
+};
+#define VM_WRITE 0x2
+#define VM_MAYWRITE 0x20
+#define vm_flags_clear(vma, flags) ((vma)->vm_flags &= ~(flags))
+#define remap_vmalloc_range(vma, addr, pgoff) 0
+
+struct module;
+#define THIS_MODULE ((struct module *)NULL)
+
+struct file_operations {
+    struct module *owner;
+    ssize_t (*read)(struct file *, char __user *, size_t, loff_t *);
+    __poll_t (*poll)(struct file *, poll_table *);
+    int (*mmap)(struct file *, struct vm_area_struct *);
+    loff_t (*llseek)(struct file *, loff_t, int);
+};
+
+struct file {
+    const struct file_operations *f_op;
+    unsigned int f_flags;
+    loff_t f_pos;
+    void *private_data;
+};
+
+static inline loff_t noop_llseek(struct file *file, loff_t offset, int whence)
+{
+    (void)offset;
+    (void)whence;
+    return file->f_pos;
+}
+
+#define KSU_HOST_MAX_FILES 16
+extern struct file *ksu_host_files[KSU_HOST_MAX_FILES];
+
+static inline int get_unused_fd_flags(unsigned int flags)
+{
+    int fd;
+
+    (void)flags;
+    for (fd = 0; fd < KSU_HOST_MAX_FILES; fd++) {
+        if (!ksu_host_files[fd])
+            return fd;
+    }
+    return -EMFILE;
+}
+
+#define put_unused_fd(fd) ((void)(fd))
+#define fd_install(fd, filp) (ksu_host_files[fd] = (filp))
+
+static inline struct file *
+anon_inode_getfile(const char *name, const struct file_operations *fops,
+                   void *priv, int flags)
+{
+    struct file *filp = calloc(1, sizeof(*filp));
+
+    (void)name;
+    if (!filp)
+        return ERR_PTR(-ENOMEM);
+    filp->f_op = fops;
+    filp->f_flags = flags;
+    filp->private_data = priv;
+    return filp;
+}
+
+static inline unsigned long copy_to_user(void __user *to, const void *from,
+                                         unsigned long n)
+{
+    memcpy(to, from, n);
+    return 0;
+}
+
+// strings and hashes
+
+// sulog.h provides strlcpy on 6.10+, keep it clear of the libc one
+#define strlcpy ksu_host_strlcpy
+
+static inline ssize_t strscpy(char *dst, const char *src, size_t size)
+{
+    size_t len = 0;
+
+    if (!size)
+        return -E2BIG;
+    while (len < size - 1 && src[len]) {
+        dst[len] = src[len];
+        len++;
+    }
+    dst[len] = '\0';
+    return src[len] ? -E2BIG : (ssize_t)len;
+}
+
+static inline u32 crc32(u32 crc, const void *buf, size_t len)
+{
+    const u8 *p = buf;
+    int i;
+
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static inline u32 jhash(const void *key, u32 length, u32 initval)
+{
+    // FNV-1a, the host build only needs some stable hash
+    const u8 *p = key;
+    u32 hash = 2166136261u ^ initval;
+
+    while (length--)
+        hash = (hash ^ *p++) * 16777619u;
+    return hash;
+}
+
+static inline u32 jhash_3words(u32 a, u32 b, u32 c, u32 initval)
+{
+    u32 words[3] = { a, b, c };
+
+    return jhash(words, sizeof(words), initval);
+}
+
+#endif
@@ -0,0 +1,148 @@
+// Host test for the sulog reader.
+//
+// Builds kernel/sulog.c against the shims in ksu_host.h, reports more events
+// than the user buffer holds and reads them back through the [ksu_sulog]
+// fd, the way ksud does right after boot. A reader that can't make progress
+// is killed by SIGALRM; any other failure exits with 1, so it can run in CI
+// on any Linux host.
+//
+// Build: make -C kernel sulog_test
+// Usage: ./sulog_test
+
+#include "../../sulog.c"
+
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+
+struct task_struct ksu_host_current = { .comm = "sulog_test", .pid = 1000 };
+struct file *ksu_host_files[KSU_HOST_MAX_FILES];
+
+int ksu_register_feature_handler(const struct ksu_feature_handler *handler)
+{
+    (void)handler;
+    return 0;
+}
+
+int ksu_unregister_feature_handler(u32 feature_id)
+{
+    (void)feature_id;
+    return 0;
+}
+
+static int failures;
+
+#define CHECK(cond, ...)                                                       \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__);               \
+            fprintf(stderr, __VA_ARGS__);                                      \
+            fputc('\n', stderr);                                               \
+            failures++;                                                        \
+        }                                                                      \
+    } while (0)
+
+// Distinct uids keep dedup from folding the events together
+static void report(uid_t first, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+        ksu_sulog_report_su_grant(first + i, "sh", "test");
+}
+
+static struct file *open_log(void)
+{
+    int fd = ksu_sulog_install_fd(O_NONBLOCK);
+
+    if (fd < 0) {
+        fprintf(stderr, "ksu_sulog_install_fd: %d\n", fd);
+        exit(1);
+    }
+    return ksu_host_files[fd];
+}
+
+// Read everything up to EAGAIN in chunks of `batch` entries and check that
+// the uids run from first_uid up to and excluding end_uid.
+static void expect_read(struct file *filp, size_t batch, uid_t first_uid,
+                        uid_t end_uid)
+{
+    struct ksu_sulog_entry *entries = calloc(batch, sizeof(*entries));
+    uid_t uid = first_uid;
+    ssize_t ret;
+
+    if (!entries)
+        exit(1);
+
+    for (;;) {
+        size_t i, n;
+
+        ret = filp->f_op->read(filp, (char *)entries,
+                               batch * sizeof(*entries), &filp->f_pos);
+        if (ret < 0)
+            break;
+        CHECK(ret > 0 && ret % sizeof(*entries) == 0, "read returned %zd",
+              ret);
+        if (ret <= 0)
+            break;
+
+        n = ret / sizeof(*entries);
+        for (i = 0; i < n; i++, uid++) {
+            CHECK(entries[i].uid == uid, "entry uid %u, expected %u",
+                  entries[i].uid, uid);
+            CHECK(entries[i].type == SULOG_EVT_SU_GRANT, "entry type %u",
+                  entries[i].type);
+        }
+    }
+
+    CHECK(ret == -EAGAIN, "read ended with %zd, expected -EAGAIN", ret);
+    CHECK(uid == end_uid, "read up to uid %u, expected %u", uid, end_uid);
+    free(entries);
+}
+
+int main(void)
+{
+    struct file *filp;
+    u64 head;
+
+    // a reader that spins on a lapped sequence never returns
+    alarm(10);
+
+    if (ksu_sulog_init()) {
+        fprintf(stderr, "ksu_sulog_init failed\n");
+        return 1;
+    }
+
+    filp = open_log();
+    expect_read(filp, 8, 0, 0);
+
+    // fewer events than the buffer holds, all of them are read
+    report(0, 100);
+    expect_read(filp, 8, 0, 100);
+
+    // a reader opened once the buffer wrapped starts at the oldest entry
+    // that is still intact
+    report(100, 300);
+    head = sulog_hdr->head;
+    filp = open_log();
+    CHECK((u64)filp->f_pos == head - (SULOG_USER_ENTRIES - 1),
+          "new reader starts at %lld, head %llu", (long long)filp->f_pos,
+          (unsigned long long)head);
+    expect_read(filp, SULOG_USER_ENTRIES, 400 - (SULOG_USER_ENTRIES - 1),
+                400);
+
+    // a reader lapped by the writer skips ahead instead of spinning
+    filp = open_log();
+    report(400, 3 * SULOG_USER_ENTRIES);
+    expect_read(filp, 1, 400 + 2 * SULOG_USER_ENTRIES + 1,
+                400 + 3 * SULOG_USER_ENTRIES);
+
+    ksu_sulog_exit();
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("sulog_test: ok\n");
+    return 0;
+}
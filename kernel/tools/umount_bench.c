@@ -0,0 +1,520 @@
+// App launch latency benchmark for the setresuid and kernel_umount hooks.
+//
+// Runs on any Linux box with KernelSU loaded (QEMU or a VM is fine, Android
+// is not needed). The process poses as zygote, puts N bind mounts over a
+// tmpfs into the try-umount list and then times fork -> unshare ->
+// setresuid(app uid) in a loop, with kernel_umount on and off.
+//
+// Build: make -C kernel umount_bench
+// Usage: ./umount_bench [-i iterations] [-u uid] [-d dir] [-n N]...
+//
+// The try-umount list and the kernel_umount feature are saved and restored,
+// but reporting EVENT_MODULE_MOUNTED cannot be undone, so don't run this on
+// a phone you care about.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define KSU_INSTALL_MAGIC1 0xDEADBEEF
+#define KSU_INSTALL_MAGIC2 0xCAFEBABE
+
+#define EVENT_MODULE_MOUNTED 3
+#define KSU_FEATURE_KERNEL_UMOUNT 1
+
+#define KSU_UMOUNT_WIPE 0
+
+#define KSU_UMOUNT_BUF_MAX (64 * 1024)
+
+struct ksu_report_event_cmd {
+    uint32_t event;
+};
+
+struct ksu_get_feature_cmd {
+    uint32_t feature_id;
+    uint64_t value;
+    uint8_t supported;
+};
+
+struct ksu_set_feature_cmd {
+    uint32_t feature_id;
+    uint64_t value;
+};
+
+struct ksu_add_try_umount_cmd {
+    uint64_t arg;
+    uint32_t flags;
+    uint8_t mode;
+};
+
+struct ksu_umount_record {
+    uint32_t flags;
+    uint32_t len;
+    char path[];
+};
+
+struct ksu_get_try_umount_cmd {
+    uint64_t buf;
+    uint32_t buf_size;
+    uint32_t cursor;
+    uint32_t count;
+    uint32_t total;
+};
+
+struct ksu_add_try_umount_bulk_cmd {
+    uint64_t buf;
+    uint32_t buf_size;
+    uint32_t count;
+    uint32_t added;
+};
+
+#define KSU_IOCTL_REPORT_EVENT _IOC(_IOC_WRITE, 'K', 3, 0)
+#define KSU_IOCTL_GET_FEATURE _IOC(_IOC_READ | _IOC_WRITE, 'K', 13, 0)
+#define KSU_IOCTL_SET_FEATURE _IOC(_IOC_WRITE, 'K', 14, 0)
+#define KSU_IOCTL_ADD_TRY_UMOUNT _IOC(_IOC_WRITE, 'K', 18, 0)
+#define KSU_IOCTL_GET_TRY_UMOUNT _IOC(_IOC_READ | _IOC_WRITE, 'K', 21, 0)
+#define KSU_IOCTL_ADD_TRY_UMOUNT_BULK _IOC(_IOC_READ | _IOC_WRITE, 'K', 22, 0)
+
+#define RECORD_SIZE(len)                                                       \
+    ((sizeof(struct ksu_umount_record) + (len) + 1 + 7) & ~(size_t)7)
+
+#define MAX_COUNTS 16
+
+static int ksu_fd = -1;
+
+static int ksu_ioctl(unsigned long request, void *arg)
+{
+    return ioctl(ksu_fd, request, arg);
+}
+
+static int ksu_open(void)
+{
+    int fd = -1;
+
+    syscall(SYS_reboot, KSU_INSTALL_MAGIC1, KSU_INSTALL_MAGIC2, 0, &fd);
+    if (fd < 0)
+        return -1;
+    ksu_fd = fd;
+    return 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int set_kernel_umount(uint64_t value)
+{
+    struct ksu_set_feature_cmd cmd = {
+        .feature_id = KSU_FEATURE_KERNEL_UMOUNT,
+        .value = value,
+    };
+
+    return ksu_ioctl(KSU_IOCTL_SET_FEATURE, &cmd);
+}
+
+static int umount_list_wipe(void)
+{
+    struct ksu_add_try_umount_cmd cmd = { .mode = KSU_UMOUNT_WIPE };
+
+    return ksu_ioctl(KSU_IOCTL_ADD_TRY_UMOUNT, &cmd);
+}
+
+// The saved list, as records ready to be fed back to the bulk add
+static char *saved_list;
+static size_t saved_size;
+static uint32_t saved_count;
+
+static int umount_list_save(void)
+{
+    struct ksu_get_try_umount_cmd cmd = { 0 };
+    char *buf = malloc(KSU_UMOUNT_BUF_MAX);
+
+    if (!buf)
+        return -1;
+
+    do {
+        cmd.buf = (uintptr_t)buf;
+        cmd.buf_size = KSU_UMOUNT_BUF_MAX;
+        if (ksu_ioctl(KSU_IOCTL_GET_TRY_UMOUNT, &cmd)) {
+            free(buf);
+            return -1;
+        }
+
+        size_t size = 0;
+        for (uint32_t i = 0; i < cmd.count; i++) {
+            struct ksu_umount_record *rec = (void *)(buf + size);
+            size += RECORD_SIZE(rec->len);
+        }
+
+        char *tmp = realloc(saved_list, saved_size + size);
+        if (!tmp) {
+            free(buf);
+            return -1;
+        }
+        saved_list = tmp;
+        memcpy(saved_list + saved_size, buf, size);
+        saved_size += size;
+        saved_count += cmd.count;
+    } while (cmd.count && cmd.cursor < cmd.total);
+
+    free(buf);
+    return 0;
+}
+
+// Bulk add count records from buf, in chunks the kernel accepts
+static int umount_list_add_records(char *buf, uint32_t count)
+{
+    size_t start = 0, offset = 0;
+    uint32_t pending = 0;
+
+    for (uint32_t i = 0; i <= count; i++) {
+        size_t rec_size = 0;
+
+        if (i < count) {
+            struct ksu_umount_record *rec = (void *)(buf + offset);
+            rec_size = RECORD_SIZE(rec->len);
+        }
+
+        if (i == count || offset + rec_size - start > KSU_UMOUNT_BUF_MAX) {
+            struct ksu_add_try_umount_bulk_cmd cmd = {
+                .buf = (uintptr_t)(buf + start),
+                .buf_size = offset - start,
+                .count = pending,
+            };
+
+            if (pending && ksu_ioctl(KSU_IOCTL_ADD_TRY_UMOUNT_BULK, &cmd))
+                return -1;
+            start = offset;
+            pending = 0;
+        }
+
+        offset += rec_size;
+        pending++;
+    }
+
+    return 0;
+}
+
+static void umount_list_restore(void)
+{
+    umount_list_wipe();
+    if (saved_count && umount_list_add_records(saved_list, saved_count))
+        fprintf(stderr, "Warning: failed to restore the try-umount list\n");
+}
+
+// tmpfs at dir, with N bind mounts of dir/src at dir/mNNNN; every tenth one
+// nested into the previous, so the deepest-first ordering gets exercised
+static int setup_mounts(const char *dir, int n, char **records)
+{
+    char path[256], src[256];
+    size_t size = 0;
+    char *buf;
+
+    if (mount("tmpfs", dir, "tmpfs", 0, "size=1m")) {
+        perror("mount tmpfs");
+        return -1;
+    }
+
+    snprintf(src, sizeof(src), "%s/src", dir);
+    mkdir(src, 0755);
+
+    buf = calloc(n ? n : 1, RECORD_SIZE(sizeof(path)));
+    if (!buf)
+        return -1;
+
+    for (int i = 0; i < n; i++) {
+        if (i % 10 == 9)
+            snprintf(path, sizeof(path), "%s/m%04d/n%04d", dir, i - 1, i);
+        else
+            snprintf(path, sizeof(path), "%s/m%04d", dir, i);
+        mkdir(path, 0755);
+        if (mount(src, path, NULL, MS_BIND, NULL)) {
+            perror("bind mount");
+            free(buf);
+            return -1;
+        }
+
+        struct ksu_umount_record *rec = (void *)(buf + size);
+        rec->flags = MNT_DETACH;
+        rec->len = strlen(path);
+        memcpy(rec->path, path, rec->len + 1);
+        size += RECORD_SIZE(rec->len);
+    }
+
+    *records = buf;
+    return 0;
+}
+
+static int count_mounts_under(const char *dir)
+{
+    char line[1024];
+    size_t len = strlen(dir);
+    int count = 0;
+    FILE *fp = fopen("/proc/self/mountinfo", "r");
+
+    if (!fp)
+        return -1;
+
+    while (fgets(line, sizeof(line), fp)) {
+        // mount id, parent id, dev, root, then the mountpoint
+        char *p = line;
+        for (int field = 0; field < 4 && p; field++) {
+            p = strchr(p, ' ');
+            if (p)
+                p++;
+        }
+        if (p && !strncmp(p, dir, len) && p[len] == '/')
+            count++;
+    }
+
+    fclose(fp);
+    return count;
+}
+
+struct sample {
+    uint64_t ns;
+    int32_t left;
+};
+
+// Like zygote: fork, own mount namespace, then drop to the app uid. The
+// umount task_work runs before setresuid returns to userspace.
+static int run_once(uid_t uid, const char *dir, struct sample *out)
+{
+    int pipefd[2];
+    pid_t pid;
+    int status;
+
+    if (pipe(pipefd))
+        return -1;
+
+    pid = fork();
+    if (pid < 0)
+        return -1;
+
+    if (pid == 0) {
+        struct sample s = { 0 };
+        uint64_t start;
+
+        close(pipefd[0]);
+        if (unshare(CLONE_NEWNS) ||
+            mount(NULL, "/", NULL, MS_REC | MS_SLAVE, NULL))
+            _exit(1);
+
+        start = now_ns();
+        if (setresuid(uid, uid, uid))
+            _exit(2);
+        s.ns = now_ns() - start;
+        s.left = count_mounts_under(dir);
+
+        if (write(pipefd[1], &s, sizeof(s)) != sizeof(s))
+            _exit(3);
+        _exit(0);
+    }
+
+    close(pipefd[1]);
+    ssize_t got = read(pipefd[0], out, sizeof(*out));
+    close(pipefd[0]);
+    waitpid(pid, &status, 0);
+
+    if (got != sizeof(*out) || !WIFEXITED(status) || WEXITSTATUS(status))
+        return -1;
+    return 0;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(uint64_t *v, int n, int pct)
+{
+    int idx = n * pct / 100;
+
+    return v[idx < n ? idx : n - 1];
+}
+
+// Fills p50/p99 in ns, returns the mounts left in the child of the first run
+static int measure(int iterations, uid_t uid, const char *dir, uint64_t *p50,
+                   uint64_t *p99)
+{
+    uint64_t *v = calloc(iterations, sizeof(*v));
+    int left = -1;
+
+    if (!v)
+        return -2;
+
+    for (int i = 0; i < iterations; i++) {
+        struct sample s;
+
+        if (run_once(uid, dir, &s)) {
+            fprintf(stderr, "Error: benchmark child failed\n");
+            free(v);
+            return -2;
+        }
+        if (i == 0)
+            left = s.left;
+        v[i] = s.ns;
+    }
+
+    qsort(v, iterations, sizeof(*v), cmp_u64);
+    *p50 = percentile(v, iterations, 50);
+    *p99 = percentile(v, iterations, 99);
+    free(v);
+    return left;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-i iterations] [-u uid] [-d dir] [-n N]...\n"
+            "  -i  forks per configuration (default 200)\n"
+            "  -u  app uid to switch to (default 10123)\n"
+            "  -d  scratch directory for the mounts (default "
+            "/tmp/ksu_umount_bench)\n"
+            "  -n  list sizes to measure, repeatable (default 0 10 100 "
+            "1000)\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    int counts[MAX_COUNTS] = { 0, 10, 100, 1000 };
+    int nr_counts = 4, custom_counts = 0;
+    int iterations = 200;
+    uid_t uid = 10123;
+    const char *dir = "/tmp/ksu_umount_bench";
+    struct ksu_get_feature_cmd feature = { .feature_id =
+                                               KSU_FEATURE_KERNEL_UMOUNT };
+    struct ksu_report_event_cmd event = { .event = EVENT_MODULE_MOUNTED };
+    int opt, ret = 1;
+
+    while ((opt = getopt(argc, argv, "i:u:d:n:h")) != -1) {
+        switch (opt) {
+        case 'i':
+            iterations = atoi(optarg);
+            break;
+        case 'u':
+            uid = atoi(optarg);
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        case 'n':
+            if (!custom_counts)
+                nr_counts = 0;
+            custom_counts = 1;
+            if (nr_counts < MAX_COUNTS)
+                counts[nr_counts++] = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (iterations <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (ksu_open()) {
+        fprintf(stderr, "Error: KernelSU driver not available\n");
+        return 1;
+    }
+
+    if (ksu_ioctl(KSU_IOCTL_GET_FEATURE, &feature) || !feature.supported) {
+        fprintf(stderr, "Error: kernel_umount feature not supported\n");
+        return 1;
+    }
+
+    if (umount_list_save()) {
+        fprintf(stderr, "Error: cannot read the try-umount list: %s\n",
+                strerror(errno));
+        return 1;
+    }
+
+    // keep our mounts away from everyone else, like zygote does
+    if (unshare(CLONE_NEWNS) ||
+        mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL)) {
+        perror("unshare");
+        return 1;
+    }
+    mkdir(dir, 0755);
+
+    // ksu_handle_umount only acts on children of zygote once modules are
+    // mounted
+    if (ksu_ioctl(KSU_IOCTL_REPORT_EVENT, &event))
+        fprintf(stderr, "Warning: cannot report module mounted: %s\n",
+                strerror(errno));
+    int fd = open("/proc/self/attr/current", O_WRONLY);
+    if (fd < 0 || write(fd, "u:r:zygote:s0", 13) != 13)
+        fprintf(stderr,
+                "Warning: cannot switch to u:r:zygote:s0, umount won't run\n");
+    if (fd >= 0)
+        close(fd);
+
+    printf("%6s %10s %10s %10s %10s %10s %10s %6s\n", "N", "off p50",
+           "off p99", "on p50", "on p99", "add p50", "add p99", "left");
+
+    for (int c = 0; c < nr_counts; c++) {
+        int n = counts[c];
+        char *records = NULL;
+        uint64_t off50, off99, on50, on99;
+        int left;
+
+        if (setup_mounts(dir, n, &records))
+            goto out;
+
+        if (umount_list_wipe() ||
+            umount_list_add_records(records, n)) {
+            fprintf(stderr, "Error: cannot fill the try-umount list: %s\n",
+                    strerror(errno));
+            free(records);
+            goto out;
+        }
+        free(records);
+
+        if (set_kernel_umount(0) ||
+            measure(iterations, uid, dir, &off50, &off99) == -2)
+            goto out;
+        if (set_kernel_umount(1) ||
+            (left = measure(iterations, uid, dir, &on50, &on99)) == -2)
+            goto out;
+
+        printf("%6d %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %6d\n", n,
+               off50 / 1000.0, off99 / 1000.0, on50 / 1000.0, on99 / 1000.0,
+               ((int64_t)on50 - (int64_t)off50) / 1000.0,
+               ((int64_t)on99 - (int64_t)off99) / 1000.0, left);
+        fflush(stdout);
+
+        umount2(dir, MNT_DETACH);
+    }
+
+    printf("times in us; left = mounts still present in the app after "
+           "setresuid (should be 0)\n");
+    ret = 0;
+
+out:
+    umount2(dir, MNT_DETACH);
+    set_kernel_umount(feature.value);
+    umount_list_restore();
+    return ret;
+}
@@ -10,6 +10,7 @@
 #include <dirent.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <sys/mman.h>
 
 #include "prelude.h"
 #include "ksu.h"
@@ -76,6 +77,77 @@ static int ksuctl(unsigned long op, void* arg) {
 	return ioctl(fd, op, arg);
 }
 
+static const struct ksu_status_page *status_page = NULL;
+static bool status_page_tried = false;
+
+static const struct ksu_status_page *get_status_page() {
+	if (status_page_tried) {
+		return status_page;
+	}
+	status_page_tried = true;
+
+	if (fd < 0) {
+		fd = scan_driver_fd();
+	}
+	if (fd < 0) {
+		return NULL;
+	}
+
+	size_t size = getpagesize();
+	void *p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		return NULL;
+	}
+	if (((const struct ksu_status_page *) p)->magic != KSU_STATUS_MAGIC) {
+		munmap(p, size);
+		return NULL;
+	}
+
+	status_page = p;
+	return status_page;
+}
+
+// Copy `len` bytes at `offset` of the status page, retrying while the
+// kernel updates it so the copy is a consistent snapshot.
+static bool read_status(size_t offset, void *out, size_t len) {
+	const struct ksu_status_page *page = get_status_page();
+	if (!page || offset + len > (size_t) getpagesize()) {
+		return false;
+	}
+
+	for (;;) {
+		uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			continue;
+		}
+		memcpy(out, (const char *) page + offset, len);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq) {
+			return true;
+		}
+	}
+}
+
+static bool status_get_feature(uint32_t feature_id, uint64_t *out_value, bool *out_supported) {
+	const struct ksu_status_page *page = get_status_page();
+	if (!page || feature_id >= page->max_feature) {
+		return false;
+	}
+
+	size_t bitmap = sizeof(struct ksu_status_page);
+	size_t values = bitmap + (page->max_feature + 63) / 64 * sizeof(uint64_t);
+	uint64_t word = 0, value = 0;
+	// two reads can straddle an update; the value alone is still consistent
+	if (!read_status(bitmap + feature_id / 64 * sizeof(uint64_t), &word, sizeof(word)) ||
+	    !read_status(values + feature_id * sizeof(uint64_t), &value, sizeof(value))) {
+		return false;
+	}
+
+	if (out_value) *out_value = value;
+	if (out_supported) *out_supported = (word >> (feature_id % 64)) & 1;
+	return true;
+}
+
 static struct ksu_get_info_cmd g_version = {0};
 
 struct ksu_get_info_cmd get_info() {
@@ -108,6 +180,14 @@ bool get_allow_list(struct ksu_get_allow_list_cmd *cmd) {
 }
 
 bool is_safe_mode() {
+    // the page only flips to 1 once something ran the check, a 0 there
+    // still needs the ioctl
+    uint8_t safe_mode = 0;
+    if (read_status(offsetof(struct ksu_status_page, safe_mode), &safe_mode, sizeof(safe_mode)) &&
+        safe_mode) {
+        return true;
+    }
+
     struct ksu_check_safemode_cmd cmd = {};
     if (ksuctl(KSU_IOCTL_CHECK_SAFEMODE, &cmd) == 0) {
         return cmd.in_safe_mode;
@@ -173,6 +253,12 @@ bool set_su_enabled(bool enabled) {
 }
 
 bool is_su_enabled() {
+    uint64_t value = 0;
+    bool supported = false;
+    if (status_get_feature(KSU_FEATURE_SU_COMPAT, &value, &supported) && supported) {
+        return value != 0;
+    }
+
     struct ksu_get_feature_cmd cmd = {};
     cmd.feature_id = KSU_FEATURE_SU_COMPAT;
     if (ksuctl(KSU_IOCTL_GET_FEATURE, &cmd) == 0 && cmd.supported) {
@@ -182,6 +268,10 @@ bool is_su_enabled() {
 }
 
 static inline bool get_feature(uint32_t feature_id, uint64_t *out_value, bool *out_supported) {
+    if (status_get_feature(feature_id, out_value, out_supported)) {
+        return true;
+    }
+
     struct ksu_get_feature_cmd cmd = {};
     cmd.feature_id = feature_id;
     if (ksuctl(KSU_IOCTL_GET_FEATURE, &cmd) != 0) {
@@ -258,6 +348,11 @@ void get_full_version(char* buff) {
 }
 
 bool is_KPM_enable(void) {
+    uint8_t kpm_enabled = 0;
+    if (read_status(offsetof(struct ksu_status_page, kpm_enabled), &kpm_enabled, sizeof(kpm_enabled))) {
+        return kpm_enabled;
+    }
+
     struct ksu_enable_kpm_cmd cmd = {};
     if (ksuctl(KSU_IOCTL_ENABLE_KPM, &cmd) == 0 && cmd.enabled) {
         return true;
@@ -266,6 +361,11 @@ bool is_KPM_enable(void) {
 }
 
 void get_hook_type(char *buff) {
+    if (read_status(offsetof(struct ksu_status_page, hook_type), buff, 32)) {
+        buff[32 - 1] = '\0';
+        return;
+    }
+
     struct ksu_hook_type_cmd cmd = {0};
     if (ksuctl(KSU_IOCTL_HOOK_TYPE, &cmd) == 0) {
         strncpy(buff, cmd.hook_type, 32 - 1);
@@ -114,6 +114,25 @@ struct ksu_become_daemon_cmd {
     uint8_t token[65]; // Input: daemon token (null-terminated)
 };
 
+// Read-only status page, mmap the driver fd (one page, offset 0)
+#define KSU_STATUS_MAGIC 0x5453534b
+
+struct ksu_status_page {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq; // odd while the kernel updates the page
+    uint32_t kernel_version;
+    uint32_t flags;
+    uint32_t max_feature;
+    int32_t manager_appid;
+    uint8_t safe_mode;
+    uint8_t kpm_enabled;
+    uint8_t reserved[2];
+    char hook_type[32];
+    // followed by uint64_t feature_supported[(max_feature + 63) / 64]
+    // and uint64_t feature_values[max_feature]
+};
+
 struct ksu_get_info_cmd {
     uint32_t version; // Output: KERNEL_SU_VERSION
     uint32_t flags; // Output: flags (bit 0: MODULE mode)
@@ -0,0 +1,132 @@
+use anyhow::Result;
+use log::warn;
+use std::fs::{self, OpenOptions};
+use std::io::{ErrorKind, Write};
+
+use crate::{defs, ksucalls, utils};
+
+// KSU_BOOT_* in kernel/supercalls.h
+const KERNEL_PHASES: &[&str] = &[
+    "module-init",
+    "init-second-stage",
+    "sepolicy",
+    "first-app-process",
+    "post-fs-data",
+    "load-allow-list",
+    "observer-init",
+    "module-mounted",
+    "boot-completed",
+    "stop-vfs-read-hook",
+    "stop-execve-hook",
+    "stop-input-hook",
+];
+
+struct Entry {
+    begin_ns: u64,
+    end_ns: u64,
+    source: &'static str,
+    name: String,
+}
+
+/// CLOCK_MONOTONIC in ns, the clock the kernel stamps its phases with
+fn now_ns() -> u64 {
+    let ts = rustix::time::clock_gettime(rustix::time::ClockId::Monotonic);
+    ts.tv_sec as u64 * 1_000_000_000 + ts.tv_nsec as u64
+}
+
+/// Start this boot's timeline, before the first stage is timed
+pub fn reset() {
+    match fs::remove_file(defs::BOOT_TIMELINE_PATH) {
+        Err(e) if e.kind() != ErrorKind::NotFound => {
+            warn!("reset boot timeline failed: {e}");
+        }
+        _ => {}
+    }
+}
+
+fn record(stage: &str, begin_ns: u64, end_ns: u64) -> Result<()> {
+    utils::ensure_dir_exists(defs::LOG_DIR)?;
+    let mut file = OpenOptions::new()
+        .create(true)
+        .append(true)
+        .open(defs::BOOT_TIMELINE_PATH)?;
+    writeln!(file, "{stage} {begin_ns} {end_ns}")?;
+    Ok(())
+}
+
+/// Run a ksud stage and add how long it took to this boot's timeline.
+/// Stages that spawn scripts without waiting only account for the spawn.
+pub fn timed<T>(stage: &str, f: impl FnOnce() -> T) -> T {
+    let begin_ns = now_ns();
+    let ret = f();
+    if let Err(e) = record(stage, begin_ns, now_ns()) {
+        warn!("record boot stage {stage} failed: {e}");
+    }
+    ret
+}
+
+fn ksud_entries() -> Vec<Entry> {
+    let Ok(content) = fs::read_to_string(defs::BOOT_TIMELINE_PATH) else {
+        return Vec::new();
+    };
+
+    content
+        .lines()
+        .filter_map(|line| {
+            let mut fields = line.split_whitespace();
+            let name = fields.next()?;
+            let begin_ns = fields.next()?.parse().ok()?;
+            let end_ns = fields.next()?.parse().ok()?;
+            Some(Entry {
+                begin_ns,
+                end_ns,
+                source: "ksud",
+                name: name.to_string(),
+            })
+        })
+        .collect()
+}
+
+/// Print the kernel's boot phases and ksud's stages in one timeline
+pub fn dump() -> Result<()> {
+    let mut entries = Vec::new();
+
+    match ksucalls::get_boot_timeline() {
+        Ok(phases) => {
+            for (i, phase) in phases.iter().enumerate() {
+                if phase.begin_ns == 0 {
+                    continue;
+                }
+                let name = KERNEL_PHASES
+                    .get(i)
+                    .map_or_else(|| format!("phase-{i}"), |name| (*name).to_string());
+                entries.push(Entry {
+                    begin_ns: phase.begin_ns,
+                    end_ns: phase.end_ns,
+                    source: "kernel",
+                    name,
+                });
+            }
+        }
+        Err(e) => eprintln!("kernel boot timeline unavailable: {e}"),
+    }
+
+    entries.extend(ksud_entries());
+    entries.sort_by_key(|entry| entry.begin_ns);
+
+    println!(
+        "{:>10} {:>10}  {:<6}  phase",
+        "at (s)", "took (ms)", "source"
+    );
+    for entry in entries {
+        println!(
+            "{:>10.3} {:>10.3}  {:<6}  {}",
+            entry.begin_ns as f64 / 1e9,
+            entry.end_ns.saturating_sub(entry.begin_ns) as f64 / 1e6,
+            entry.source,
+            entry.name
+        );
+    }
+
+    Ok(())
+}
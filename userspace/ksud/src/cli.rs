@@ -9,7 +9,8 @@ use crate::boot_patch::{BootPatchArgs, BootRestoreArgs};
 #[cfg(target_arch = "aarch64")]
 use crate::susfs;
 use crate::{
-    apk_sign, assets, debug, defs, init_event, ksucalls, module, module_config, umount, utils,
+    apk_sign, assets, boot_timeline, debug, defs, init_event, ksucalls, module, module_config,
+    sulog, umount, utils,
 };
 
 /// KernelSU userspace cli
@@ -37,6 +38,9 @@ enum Commands {
     /// Trigger `boot-complete` event
     BootCompleted,
 
+    /// Persist kernel su log events, started by `post-fs-data`
+    Sulogd,
+
     #[cfg(target_arch = "aarch64")]
     /// Susfs
     Susfs {
@@ -165,11 +169,21 @@ enum Debug {
     /// For testing
     Test,
 
+    /// Print the persisted su log across all segments
+    Sulog {
+        /// only show entries at or after this unix timestamp
+        #[arg(long)]
+        since: Option<i64>,
+    },
+
     /// Process mark management
     Mark {
         #[command(subcommand)]
         command: MarkCommand,
     },
+
+    /// Show when each kernel and ksud boot phase ran and how long it took
+    BootTimeline,
 }
 
 #[derive(clap::Subcommand, Debug)]
@@ -500,6 +514,7 @@ pub fn run() -> Result<()> {
             init_event::on_boot_completed();
             Ok(())
         }
+        Commands::Sulogd => sulog::run_daemon(),
         #[cfg(target_arch = "aarch64")]
         Commands::Susfs { command } => {
             match command {
@@ -655,6 +670,8 @@ pub fn run() -> Result<()> {
             }
             Debug::Su { global_mnt } => crate::su::grant_root(global_mnt),
             Debug::Test => assets::ensure_binaries(false),
+            Debug::Sulog { since } => sulog::dump(since),
+            Debug::BootTimeline => boot_timeline::dump(),
             Debug::Mark { command } => match command {
                 MarkCommand::Get { pid } => debug::mark_get(pid),
                 MarkCommand::Mark { pid } => debug::mark_set(pid),
@@ -710,8 +727,11 @@ pub fn run() -> Result<()> {
             Umount::Add { mnt, flags } => ksucalls::umount_list_add(&mnt, flags),
             Umount::Remove { mnt } => umount::remove_umount_entry_from_config(&mnt),
             Umount::List => {
-                let list = ksucalls::umount_list_list()?;
-                print!("{list}");
+                println!("Mount Point\tFlags");
+                println!("----------\t-----");
+                for (path, flags) in ksucalls::umount_list_entries()? {
+                    println!("{path}\t{flags}");
+                }
                 Ok(())
             }
             Umount::Save => umount::save_umount_config(),
@@ -6,6 +6,10 @@ mod android {
     pub const WORKING_DIR: &str = concatcp!(ADB_DIR, "ksu/");
     pub const BINARY_DIR: &str = concatcp!(WORKING_DIR, "bin/");
     pub const LOG_DIR: &str = concatcp!(WORKING_DIR, "log/");
+    pub const SULOG_PATH: &str = concatcp!(LOG_DIR, "sulog.log");
+    pub const SULOG_INDEX_PATH: &str = concatcp!(LOG_DIR, "sulog.idx");
+    pub const BOOT_TIMELINE_PATH: &str = concatcp!(LOG_DIR, "boot_timeline");
+    pub const SULOG_COMPRESS_FLAG: &str = concatcp!(WORKING_DIR, ".sulog_compress");
 
     pub const PROFILE_DIR: &str = concatcp!(WORKING_DIR, "profile/");
     pub const PROFILE_SELINUX_DIR: &str = concatcp!(PROFILE_DIR, "selinux/");
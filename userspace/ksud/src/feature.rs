@@ -157,21 +157,34 @@ pub fn save_binary_config(features: &HashMap<u32, u64>) -> Result<()> {
 pub fn apply_config(features: &HashMap<u32, u64>) {
     log::info!("Applying feature configuration to kernel...");
 
+    let features: Vec<(u32, u64)> = features.iter().map(|(&id, &value)| (id, value)).collect();
     let mut applied = 0;
-    for (&id, &value) in features {
-        match crate::ksucalls::set_feature(id, value) {
-            Ok(()) => {
-                if let Some(feature_id) = FeatureId::from_u32(id) {
-                    log::info!("Set feature {} to {value}", feature_id.name());
-                } else {
-                    log::info!("Set feature {id} to {value}");
-                }
-                applied += 1;
+    let mut next = 0;
+
+    // one ioctl for everything; when one feature fails, log it and go on
+    // with the rest
+    while next < features.len() {
+        let mut batch = crate::ksucalls::Batch::new();
+        for &(id, value) in &features[next..] {
+            batch.set_feature(id, value);
+        }
+        let end = match batch.submit() {
+            Ok(()) => features.len(),
+            Err((i, e)) => {
+                log::warn!("Failed to set feature {}: {e}", features[next + i].0);
+                next + i
             }
-            Err(e) => {
-                log::warn!("Failed to set feature {id}: {e}");
+        };
+
+        for &(id, value) in &features[next..end] {
+            if let Some(feature_id) = FeatureId::from_u32(id) {
+                log::info!("Set feature {} to {value}", feature_id.name());
+            } else {
+                log::info!("Set feature {id} to {value}");
             }
+            applied += 1;
         }
+        next = end + 1;
     }
 
     log::info!("Applied {applied} features successfully");
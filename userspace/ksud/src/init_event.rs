@@ -3,7 +3,7 @@ use crate::kpm;
 use crate::module::{handle_updated_modules, prune_modules};
 use crate::utils::is_safe_mode;
 use crate::{
-    assets, defs, ksucalls, metamodule, restorecon,
+    assets, boot_timeline, defs, ksucalls, metamodule, restorecon,
     utils::{self},
 };
 use anyhow::{Context, Result};
@@ -11,10 +11,20 @@ use log::{info, warn};
 use std::path::Path;
 
 pub fn on_post_data_fs() -> Result<()> {
+    boot_timeline::reset();
+    boot_timeline::timed("post-fs-data", post_fs_data)
+}
+
+fn post_fs_data() -> Result<()> {
     ksucalls::report_post_fs_data();
 
     utils::umask(0);
 
+    // the kernel only buffers su events, persisting them is our job
+    if let Err(e) = crate::sulog::start_daemon() {
+        warn!("start sulogd failed: {e}");
+    }
+
     // Clear all temporary module configs early
     if let Err(e) = crate::module_config::clear_all_temp_configs() {
         warn!("clear temp configs failed: {e}");
@@ -38,14 +48,17 @@ pub fn on_post_data_fs() -> Result<()> {
         warn!("safe mode, skip common post-fs-data.d scripts");
     } else {
         // Then exec common post-fs-data scripts
-        if let Err(e) = crate::module::exec_common_scripts("post-fs-data.d", true) {
+        if let Err(e) = boot_timeline::timed("post-fs-data.d", || {
+            crate::module::exec_common_scripts("post-fs-data.d", true)
+        }) {
             warn!("exec common post-fs-data scripts failed: {e}");
         }
     }
 
     let module_dir = defs::MODULE_DIR;
 
-    assets::ensure_binaries(true).with_context(|| "Failed to extract bin assets")?;
+    boot_timeline::timed("binaries", || assets::ensure_binaries(true))
+        .with_context(|| "Failed to extract bin assets")?;
 
     // if we are in safe mode, we should disable all modules
     if safe_mode {
@@ -56,31 +69,35 @@ pub fn on_post_data_fs() -> Result<()> {
         return Ok(());
     }
 
-    if let Err(e) = handle_updated_modules() {
-        warn!("handle updated modules failed: {e}");
-    }
+    boot_timeline::timed("update-modules", || {
+        if let Err(e) = handle_updated_modules() {
+            warn!("handle updated modules failed: {e}");
+        }
 
-    if let Err(e) = prune_modules() {
-        warn!("prune modules failed: {e}");
-    }
+        if let Err(e) = prune_modules() {
+            warn!("prune modules failed: {e}");
+        }
+    });
 
-    if let Err(e) = restorecon::restorecon() {
+    if let Err(e) = boot_timeline::timed("restorecon", restorecon::restorecon) {
         warn!("restorecon failed: {e}");
     }
 
-    // load sepolicy.rule
-    if crate::module::load_sepolicy_rule().is_err() {
-        warn!("load sepolicy.rule failed");
-    }
+    boot_timeline::timed("sepolicy", || {
+        // load sepolicy.rule
+        if crate::module::load_sepolicy_rule().is_err() {
+            warn!("load sepolicy.rule failed");
+        }
 
-    if let Err(e) = crate::profile::apply_sepolies() {
-        warn!("apply root profile sepolicy failed: {e}");
-    }
+        if let Err(e) = crate::profile::apply_sepolies() {
+            warn!("apply root profile sepolicy failed: {e}");
+        }
+    });
 
     // load feature config
     if is_safe_mode() {
         warn!("safe mode, skip load feature config");
-    } else if let Err(e) = crate::feature::init_features() {
+    } else if let Err(e) = boot_timeline::timed("features", crate::feature::init_features) {
         warn!("init features failed: {e}");
     }
 
@@ -89,16 +106,18 @@ pub fn on_post_data_fs() -> Result<()> {
         warn!("KPM: Failed to start KPM watcher: {e}");
     }
 
-    // execute metamodule post-fs-data script first (priority)
-    if let Err(e) = metamodule::exec_stage_script("post-fs-data", true) {
-        warn!("exec metamodule post-fs-data script failed: {e}");
-    }
+    boot_timeline::timed("post-fs-data-scripts", || {
+        // execute metamodule post-fs-data script first (priority)
+        if let Err(e) = metamodule::exec_stage_script("post-fs-data", true) {
+            warn!("exec metamodule post-fs-data script failed: {e}");
+        }
 
-    // exec modules post-fs-data scripts
-    // TODO: Add timeout
-    if let Err(e) = crate::module::exec_stage_script("post-fs-data", true) {
-        warn!("exec post-fs-data scripts failed: {e}");
-    }
+        // exec modules post-fs-data scripts
+        // TODO: Add timeout
+        if let Err(e) = crate::module::exec_stage_script("post-fs-data", true) {
+            warn!("exec post-fs-data scripts failed: {e}");
+        }
+    });
 
     // load system.prop
     if let Err(e) = crate::module::load_system_prop() {
@@ -106,12 +125,14 @@ pub fn on_post_data_fs() -> Result<()> {
     }
 
     // execute metamodule mount script
-    if let Err(e) = metamodule::exec_mount_script(module_dir) {
+    if let Err(e) = boot_timeline::timed("metamodule-mount", || {
+        metamodule::exec_mount_script(module_dir)
+    }) {
         warn!("execute metamodule mount failed: {e}");
     }
 
     // Load umount config and apply to kernel
-    if let Err(e) = crate::umount::load_umount_config() {
+    if let Err(e) = boot_timeline::timed("umount-config", crate::umount::load_umount_config) {
         warn!("load umount config failed: {e}");
     }
 
@@ -123,6 +144,10 @@ pub fn on_post_data_fs() -> Result<()> {
 }
 
 fn run_stage(stage: &str, block: bool) {
+    boot_timeline::timed(stage, || exec_stage(stage, block));
+}
+
+fn exec_stage(stage: &str, block: bool) {
     utils::umask(0);
 
     if utils::has_magisk() {
@@ -21,6 +21,12 @@ const KSU_IOCTL_GET_WRAPPER_FD: i32 = _IOW::<()>(K, 15);
 const KSU_IOCTL_MANAGE_MARK: i32 = _IOWR::<()>(K, 16);
 const KSU_IOCTL_NUKE_EXT4_SYSFS: i32 = _IOW::<()>(K, 17);
 const KSU_IOCTL_ADD_TRY_UMOUNT: i32 = _IOW::<()>(K, 18);
+const KSU_IOCTL_GET_SULOG_FD: i32 = _IOW::<()>(K, 19);
+const KSU_IOCTL_BATCH: i32 = _IOWR::<()>(K, 20);
+const KSU_IOCTL_GET_TRY_UMOUNT: i32 = _IOWR::<()>(K, 21);
+const KSU_IOCTL_ADD_TRY_UMOUNT_BULK: i32 = _IOWR::<()>(K, 22);
+const KSU_IOCTL_GET_BOOT_TIMELINE: i32 = _IOR::<()>(K, 23);
+const KSU_IOCTL_LIST_TRY_UMOUNT: i32 = _IOWR::<()>(K, 200);
 
 #[repr(C)]
 #[derive(Clone, Copy, Default)]
@@ -91,6 +97,47 @@ struct AddTryUmountCmd {
     mode: u8,   // denotes what to do with it 0:wipe_list 1:add_to_list 2:delete_entry
 }
 
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct GetSulogFdCmd {
+    flags: u32,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct BatchEntry {
+    cmd: u32,
+    result: i32,
+    arg: u64,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct BatchCmd {
+    entries: u64,
+    count: u32,
+    done: u32,
+}
+
+const KSU_BATCH_MAX: usize = 256;
+
+const KSU_BOOT_PHASE_MAX: usize = 32;
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct BootPhase {
+    pub begin_ns: u64,
+    pub end_ns: u64,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct GetBootTimelineCmd {
+    count: u32,
+    reserved: u32,
+    phases: [BootPhase; KSU_BOOT_PHASE_MAX],
+}
+
 // Mark operation constants
 const KSU_MARK_GET: u32 = 1;
 const KSU_MARK_MARK: u32 = 2;
@@ -212,6 +259,18 @@ pub fn set_sepolicy(cmd: &SetSepolicyCmd) -> std::io::Result<()> {
     Ok(())
 }
 
+/// Kernel boot phase timestamps (CLOCK_MONOTONIC), indexed by KSU_BOOT_*
+pub fn get_boot_timeline() -> std::io::Result<Vec<BootPhase>> {
+    let mut cmd = GetBootTimelineCmd {
+        count: 0,
+        reserved: 0,
+        phases: [BootPhase::default(); KSU_BOOT_PHASE_MAX],
+    };
+    ksuctl(KSU_IOCTL_GET_BOOT_TIMELINE, &raw mut cmd)?;
+    let count = (cmd.count as usize).min(KSU_BOOT_PHASE_MAX);
+    Ok(cmd.phases[..count].to_vec())
+}
+
 /// Get feature value and support status from kernel
 /// Returns (value, supported)
 pub fn get_feature(feature_id: u32) -> std::io::Result<(u64, bool)> {
@@ -237,6 +296,13 @@ pub fn get_wrapped_fd(fd: RawFd) -> std::io::Result<RawFd> {
     Ok(result)
 }
 
+/// Get a blocking read fd for the kernel sulog event stream
+pub fn get_sulog_fd() -> std::io::Result<RawFd> {
+    let mut cmd = GetSulogFdCmd { flags: 0 };
+    let result = ksuctl(KSU_IOCTL_GET_SULOG_FD, &raw mut cmd)?;
+    Ok(result)
+}
+
 /// Get mark status for a process (pid=0 returns total marked count)
 pub fn mark_get(pid: i32) -> std::io::Result<u32> {
     let mut cmd = ManageMarkCmd {
@@ -325,7 +391,24 @@ pub fn umount_list_del(path: &str) -> anyhow::Result<()> {
     Ok(())
 }
 
-const KSU_IOCTL_LIST_TRY_UMOUNT: i32 = _IOWR::<()>(K, 200);
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct GetTryUmountCmd {
+    buf: u64,
+    buf_size: u32,
+    cursor: u32,
+    count: u32,
+    total: u32,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct AddTryUmountBulkCmd {
+    buf: u64,
+    buf_size: u32,
+    count: u32,
+    added: u32,
+}
 
 #[repr(C)]
 #[derive(Clone, Copy, Default)]
@@ -334,8 +417,59 @@ struct ListTryUmountCmd {
     buf_size: u32,
 }
 
-/// List all mount points in umount list
-pub fn umount_list_list() -> anyhow::Result<String> {
+// struct ksu_umount_record: u32 flags, u32 len, NUL terminated path, the
+// whole record padded to 8 bytes
+const UMOUNT_RECORD_HDR: usize = 8;
+const UMOUNT_BUF_MAX: usize = 64 * 1024;
+
+const fn umount_record_size(len: usize) -> usize {
+    (UMOUNT_RECORD_HDR + len + 1 + 7) & !7
+}
+
+/// Read the whole umount list as (path, flags) pairs, in kernel order
+pub fn umount_list_entries() -> anyhow::Result<Vec<(String, u32)>> {
+    let mut buffer = vec![0u8; UMOUNT_BUF_MAX];
+    let mut entries = Vec::new();
+    let mut cursor = 0;
+
+    loop {
+        let mut cmd = GetTryUmountCmd {
+            buf: buffer.as_mut_ptr() as u64,
+            buf_size: UMOUNT_BUF_MAX as u32,
+            cursor,
+            ..Default::default()
+        };
+        match ksuctl(KSU_IOCTL_GET_TRY_UMOUNT, &raw mut cmd) {
+            Ok(_) => {}
+            Err(e) if e.raw_os_error() == Some(libc::ENOTTY) && cursor == 0 => {
+                return umount_list_legacy();
+            }
+            Err(e) => return Err(e.into()),
+        }
+
+        let mut offset = 0;
+        for _ in 0..cmd.count {
+            let hdr = &buffer[offset..offset + UMOUNT_RECORD_HDR];
+            let flags = u32::from_ne_bytes(hdr[0..4].try_into()?);
+            let len = u32::from_ne_bytes(hdr[4..8].try_into()?) as usize;
+            let path = &buffer[offset + UMOUNT_RECORD_HDR..offset + UMOUNT_RECORD_HDR + len];
+            entries.push((String::from_utf8_lossy(path).into_owned(), flags));
+            offset += umount_record_size(len);
+        }
+
+        // the list may shrink between calls, stop once nothing comes back
+        if cmd.count == 0 || cmd.cursor >= cmd.total {
+            break;
+        }
+        cursor = cmd.cursor;
+    }
+
+    Ok(entries)
+}
+
+// Older kernels only have the text listing: two header lines, then one
+// "path\tflags" line per entry
+fn umount_list_legacy() -> anyhow::Result<Vec<(String, u32)>> {
     const BUF_SIZE: usize = 4096;
     let mut buffer = vec![0u8; BUF_SIZE];
     let mut cmd = ListTryUmountCmd {
@@ -344,8 +478,161 @@ pub fn umount_list_list() -> anyhow::Result<String> {
     };
     ksuctl(KSU_IOCTL_LIST_TRY_UMOUNT, &raw mut cmd)?;
 
-    // Find null terminator or end of buffer
     let len = buffer.iter().position(|&b| b == 0).unwrap_or(BUF_SIZE);
-    let result = String::from_utf8_lossy(&buffer[..len]).to_string();
-    Ok(result)
+    let output = String::from_utf8_lossy(&buffer[..len]);
+    let entries = output
+        .lines()
+        .skip(2)
+        .filter_map(|line| line.rsplit_once('\t'))
+        .map(|(path, flags)| (path.to_string(), flags.trim().parse().unwrap_or(0)))
+        .collect();
+    Ok(entries)
+}
+
+/// Add many mount points with as few ioctls as possible, returns how many
+/// were new. Falls back to one ioctl per path on older kernels.
+pub fn umount_list_add_bulk(entries: &[(String, u32)]) -> anyhow::Result<usize> {
+    let mut added = 0;
+    let mut buffer = Vec::with_capacity(UMOUNT_BUF_MAX);
+    let mut pending = 0;
+    let mut chunk_start = 0;
+
+    let mut flush = |buffer: &mut Vec<u8>, count: u32| -> std::io::Result<u32> {
+        let mut cmd = AddTryUmountBulkCmd {
+            buf: buffer.as_mut_ptr() as u64,
+            buf_size: buffer.len() as u32,
+            count,
+            added: 0,
+        };
+        ksuctl(KSU_IOCTL_ADD_TRY_UMOUNT_BULK, &raw mut cmd)?;
+        buffer.clear();
+        Ok(cmd.added)
+    };
+
+    for (i, (path, flags)) in entries.iter().enumerate() {
+        if path.is_empty() || path.len() >= 256 || path.contains('\0') {
+            anyhow::bail!("invalid umount path: {path:?}");
+        }
+        let size = umount_record_size(path.len());
+        if buffer.len() + size > UMOUNT_BUF_MAX {
+            match flush(&mut buffer, pending) {
+                Ok(n) => added += n as usize,
+                Err(e) if e.raw_os_error() == Some(libc::ENOTTY) && chunk_start == 0 => {
+                    return umount_list_add_one_by_one(entries);
+                }
+                Err(e) => return Err(e.into()),
+            }
+            pending = 0;
+            chunk_start = i;
+        }
+        buffer.extend_from_slice(&flags.to_ne_bytes());
+        buffer.extend_from_slice(&(path.len() as u32).to_ne_bytes());
+        buffer.extend_from_slice(path.as_bytes());
+        buffer.resize(buffer.len() + size - UMOUNT_RECORD_HDR - path.len(), 0);
+        pending += 1;
+    }
+
+    if pending > 0 {
+        match flush(&mut buffer, pending) {
+            Ok(n) => added += n as usize,
+            Err(e) if e.raw_os_error() == Some(libc::ENOTTY) && chunk_start == 0 => {
+                return umount_list_add_one_by_one(entries);
+            }
+            Err(e) => return Err(e.into()),
+        }
+    }
+
+    Ok(added)
+}
+
+fn umount_list_add_one_by_one(entries: &[(String, u32)]) -> anyhow::Result<usize> {
+    let mut added = 0;
+    for (path, flags) in entries {
+        // the old interface reports duplicates as an error
+        if umount_list_add(path, *flags).is_ok() {
+            added += 1;
+        }
+    }
+    Ok(added)
+}
+
+/// Several commands submitted with a single KSU_IOCTL_BATCH ioctl. The
+/// kernel runs them in order and stops at the first failing one.
+#[derive(Default)]
+pub struct Batch {
+    entries: Vec<BatchEntry>,
+    // argument structs and the strings they point to, alive until submit
+    args: Vec<Box<dyn std::any::Any>>,
+}
+
+impl Batch {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    fn push<T: 'static>(&mut self, request: i32, arg: T) {
+        let mut arg = Box::new(arg);
+        self.entries.push(BatchEntry {
+            cmd: request as u32,
+            result: 0,
+            arg: (&raw mut *arg) as u64,
+        });
+        self.args.push(arg);
+    }
+
+    pub fn set_feature(&mut self, feature_id: u32, value: u64) {
+        self.push(KSU_IOCTL_SET_FEATURE, SetFeatureCmd { feature_id, value });
+    }
+
+    /// `data` owns what `cmd.arg` points to and lives until submit; it is
+    /// moved, so the pointers must lead into heap memory it owns.
+    pub fn set_sepolicy<T: 'static>(&mut self, cmd: SetSepolicyCmd, data: T) {
+        self.args.push(Box::new(data));
+        self.push(KSU_IOCTL_SET_SEPOLICY, cmd);
+    }
+
+    fn submit_one_by_one(&mut self, start: usize) -> Result<(), (usize, std::io::Error)> {
+        for (i, entry) in self.entries.iter_mut().enumerate().skip(start) {
+            entry.result = ksuctl(entry.cmd as i32, entry.arg as *mut u8).map_err(|e| (i, e))?;
+        }
+        Ok(())
+    }
+
+    fn submit_from(&mut self, start: usize) -> Result<(), (usize, std::io::Error)> {
+        for (n, chunk) in self.entries[start..].chunks_mut(KSU_BATCH_MAX).enumerate() {
+            let base = start + n * KSU_BATCH_MAX;
+            let mut cmd = BatchCmd {
+                entries: chunk.as_mut_ptr() as u64,
+                count: chunk.len() as u32,
+                done: 0,
+            };
+            match ksuctl(KSU_IOCTL_BATCH, &raw mut cmd) {
+                Ok(_) => {}
+                Err(e) if e.raw_os_error() == Some(libc::ENOTTY) && cmd.done == 0 && n == 0 => {
+                    return self.submit_one_by_one(start);
+                }
+                Err(e) => return Err((base + (cmd.done as usize).saturating_sub(1), e)),
+            }
+        }
+        Ok(())
+    }
+
+    /// Run all commands. On failure, returns the index of the failing
+    /// command and its error; the commands before it have been applied.
+    /// Falls back to one ioctl per command on kernels without batching.
+    pub fn submit(mut self) -> Result<(), (usize, std::io::Error)> {
+        self.submit_from(0)
+    }
+
+    /// Like submit, but carry on after a failing command. Returns the
+    /// index and error of every command that failed.
+    pub fn submit_all(mut self) -> Vec<(usize, std::io::Error)> {
+        let mut errors = Vec::new();
+        let mut start = 0;
+        while let Err((i, e)) = self.submit_from(start) {
+            errors.push((i, e));
+            start = i + 1;
+        }
+        errors
+    }
 }
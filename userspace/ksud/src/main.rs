@@ -14,6 +14,8 @@ mod apk_sign;
 mod assets;
 mod boot_patch;
 #[cfg(target_os = "android")]
+mod boot_timeline;
+#[cfg(target_os = "android")]
 mod cli;
 #[cfg(not(target_os = "android"))]
 mod cli_non_android;
@@ -42,6 +44,8 @@ mod restorecon;
 mod sepolicy;
 #[cfg(target_os = "android")]
 mod su;
+#[cfg(target_os = "android")]
+mod sulog;
 #[cfg(target_arch = "aarch64")]
 mod susfs;
 #[cfg(target_os = "android")]
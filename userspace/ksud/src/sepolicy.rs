@@ -676,8 +676,8 @@ const fn to_c_ptr(pol: &PolicyObject) -> *const ffi::c_char {
     }
 }
 
-impl From<AtomicStatement> for FfiPolicy {
-    fn from(policy: AtomicStatement) -> Self {
+impl From<&AtomicStatement> for FfiPolicy {
+    fn from(policy: &AtomicStatement) -> Self {
         Self {
             cmd: policy.cmd,
             subcmd: policy.subcmd,
@@ -692,33 +692,54 @@ impl From<AtomicStatement> for FfiPolicy {
     }
 }
 
-fn apply_one_rule<'a>(statement: &'a PolicyStatement<'a>, strict: bool) -> Result<()> {
+// Queue every atomic rule of the statement; a module's rules then go to the
+// kernel in one batch instead of one ioctl each
+fn queue_rule<'a>(
+    batch: &mut crate::ksucalls::Batch,
+    statement: &'a PolicyStatement<'a>,
+) -> Result<usize> {
     let policies: Vec<AtomicStatement> = statement.try_into()?;
+    let count = policies.len();
 
     for policy in policies {
-        let ffi_policy = FfiPolicy::from(policy);
+        // boxed so the pointers stay put while the batch holds them
+        let policy = Box::new(policy);
+        let ffi_policy = Box::new(FfiPolicy::from(&*policy));
         let cmd = crate::ksucalls::SetSepolicyCmd {
             cmd: 0,
-            arg: &raw const ffi_policy as u64,
+            arg: &raw const *ffi_policy as u64,
         };
-        if let Err(e) = crate::ksucalls::set_sepolicy(&cmd) {
-            log::warn!("apply rule {statement:?} failed: {e}");
-            if strict {
-                return Err(anyhow::anyhow!("apply rule {:?} failed: {}", statement, e));
-            }
-        }
+        batch.set_sepolicy(cmd, (policy, ffi_policy));
     }
 
-    Ok(())
+    Ok(count)
 }
 
 pub fn live_patch(policy: &str) -> Result<()> {
     let result = parse_sepolicy(policy.trim(), false)?;
-    for statement in result {
+    let mut batch = crate::ksucalls::Batch::new();
+    // statement each queued rule came from, to report failures
+    let mut origin = Vec::new();
+    let mut queued = Ok(());
+
+    for (i, statement) in result.iter().enumerate() {
         println!("{statement:?}");
-        apply_one_rule(&statement, false)?;
+        match queue_rule(&mut batch, statement) {
+            Ok(count) => origin.extend(std::iter::repeat_n(i, count)),
+            Err(e) => {
+                // still apply the rules before it
+                queued = Err(e);
+                break;
+            }
+        }
     }
-    Ok(())
+
+    // a failing rule doesn't keep the others from being applied
+    for (i, e) in batch.submit_all() {
+        log::warn!("apply rule {:?} failed: {e}", result[origin[i]]);
+    }
+
+    queued
 }
 
 pub fn apply_file<P: AsRef<Path>>(path: P) -> Result<()> {
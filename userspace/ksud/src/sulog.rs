@@ -0,0 +1,382 @@
+use std::fs::{self, File, OpenOptions};
+use std::io::{BufRead, BufReader, ErrorKind, Read, Write};
+use std::os::fd::FromRawFd;
+use std::os::unix::process::CommandExt;
+use std::path::{Path, PathBuf};
+
+use anyhow::{Context, Result};
+use chrono::{Local, TimeZone};
+use log::{info, warn};
+
+use crate::{defs, ksucalls, utils};
+
+// must match enum sulog_event_type in kernel/sulog.h
+const SULOG_EVT_SU_GRANT: u8 = 0;
+const SULOG_EVT_SU_ATTEMPT: u8 = 1;
+const SULOG_EVT_PERM_CHECK: u8 = 2;
+const SULOG_EVT_MANAGER_OP: u8 = 3;
+const SULOG_EVT_SYSCALL: u8 = 4;
+const SULOG_EVT_DROPPED: u8 = 5;
+
+const KSU_SULOG_F_REPEAT: u8 = 1 << 0;
+
+// sulog.log is always the current segment, older ones are kept as
+// sulog.<seq>.log (or .log.zip) and listed in sulog.idx, newest first.
+const SULOG_SEGMENT_SIZE: u64 = 4 * 1024 * 1024;
+const SULOG_SEGMENTS: usize = 8;
+const SULOG_INDEX_MAGIC: &str = "sulog-index 1";
+const READ_BATCH: usize = 64;
+
+/// struct ksu_sulog_entry in kernel/sulog.h
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct SulogEntry {
+    ts_ns: u64,
+    uid: u32,
+    target_uid: u32,
+    pid: i32,
+    count: u32,
+    kind: u8,
+    result: u8,
+    flags: u8,
+    reserved: [u8; 5],
+    name: [u8; 32],
+    args: [u8; 64],
+    comm: [u8; 256],
+}
+
+const ENTRY_SIZE: usize = std::mem::size_of::<SulogEntry>();
+
+fn cstr(buf: &[u8]) -> String {
+    let len = buf.iter().position(|&b| b == 0).unwrap_or(buf.len());
+    String::from_utf8_lossy(&buf[..len]).into_owned()
+}
+
+fn or_default(s: String, default: &str) -> String {
+    if s.is_empty() { default.to_string() } else { s }
+}
+
+fn format_entry(e: &SulogEntry) -> Option<String> {
+    let ts = Local
+        .timestamp_nanos(e.ts_ns as i64)
+        .format("%Y-%m-%d %H:%M:%S");
+    let comm = cstr(&e.comm);
+    let name = or_default(cstr(&e.name), "unknown");
+    let uid = e.uid as i32;
+    let pid = e.pid;
+
+    let line = match e.kind {
+        SULOG_EVT_SU_GRANT => {
+            format!("[{ts}] SU_GRANT: UID={uid} COMM={comm} METHOD={name} PID={pid}")
+        }
+        SULOG_EVT_SU_ATTEMPT => format!(
+            "[{ts}] SU_EXEC: UID={uid} COMM={comm} TARGET={} RESULT={} PID={pid}",
+            or_default(cstr(&e.args), "unknown"),
+            if e.result != 0 { "SUCCESS" } else { "DENIED" }
+        ),
+        SULOG_EVT_PERM_CHECK => format!(
+            "[{ts}] PERM_CHECK: UID={uid} COMM={comm} RESULT={} PID={pid}",
+            if e.result != 0 { "ALLOWED" } else { "DENIED" }
+        ),
+        SULOG_EVT_MANAGER_OP => format!(
+            "[{ts}] MANAGER_OP: OP={name} MANAGER_UID={uid} TARGET_UID={} COMM={comm} PID={pid}",
+            e.target_uid as i32
+        ),
+        SULOG_EVT_SYSCALL => format!(
+            "[{ts}] SYSCALL: UID={uid} COMM={comm} SYSCALL={name} ARGS={} PID={pid}",
+            or_default(cstr(&e.args), "none")
+        ),
+        SULOG_EVT_DROPPED => format!("[{ts}] SULOG_DROPPED: COUNT={}", e.count),
+        _ => return None,
+    };
+
+    // dedup summary: the same event was suppressed `count` more times
+    if e.flags & KSU_SULOG_F_REPEAT != 0 {
+        return Some(format!("{line} REPEATED={}\n", e.count));
+    }
+
+    Some(line + "\n")
+}
+
+fn open_log() -> Result<File> {
+    utils::ensure_dir_exists(defs::LOG_DIR)?;
+    OpenOptions::new()
+        .create(true)
+        .append(true)
+        .open(defs::SULOG_PATH)
+        .with_context(|| format!("Failed to open {}", defs::SULOG_PATH))
+}
+
+/// A rotated segment, `first`/`last` are unix seconds of its first and last
+/// line.
+struct Segment {
+    first: i64,
+    last: i64,
+    file: String,
+}
+
+fn load_index() -> Vec<Segment> {
+    let Ok(content) = fs::read_to_string(defs::SULOG_INDEX_PATH) else {
+        return Vec::new();
+    };
+
+    let mut lines = content.lines();
+    if lines.next() != Some(SULOG_INDEX_MAGIC) {
+        warn!("sulogd: ignoring unknown index format");
+        return Vec::new();
+    }
+
+    lines
+        .filter_map(|line| {
+            let mut parts = line.splitn(3, ' ');
+            let first = parts.next()?.parse().ok()?;
+            let last = parts.next()?.parse().ok()?;
+            let file = parts.next()?.to_string();
+            Some(Segment { first, last, file })
+        })
+        .collect()
+}
+
+fn save_index(segments: &[Segment]) -> Result<()> {
+    let mut content = format!("{SULOG_INDEX_MAGIC}\n");
+    for seg in segments {
+        content.push_str(&format!("{} {} {}\n", seg.first, seg.last, seg.file));
+    }
+
+    // write then rename, so a reader never sees a half written index
+    let tmp = format!("{}.tmp", defs::SULOG_INDEX_PATH);
+    fs::write(&tmp, content)?;
+    fs::rename(&tmp, defs::SULOG_INDEX_PATH)?;
+    Ok(())
+}
+
+fn segment_path(file: &str) -> PathBuf {
+    Path::new(defs::LOG_DIR).join(file)
+}
+
+fn compress_segment(file: &str) -> Result<String> {
+    use zip::write::SimpleFileOptions;
+
+    let zipped = format!("{file}.zip");
+    let mut writer = zip::ZipWriter::new(File::create(segment_path(&zipped))?);
+    writer.start_file(
+        file,
+        SimpleFileOptions::default().compression_method(zip::CompressionMethod::Deflated),
+    )?;
+    std::io::copy(&mut File::open(segment_path(file))?, &mut writer)?;
+    writer.finish()?;
+    fs::remove_file(segment_path(file))?;
+
+    Ok(zipped)
+}
+
+/// Parse the `[YYYY-MM-DD HH:MM:SS]` prefix of a log line.
+fn line_timestamp(line: &str) -> Option<i64> {
+    let ts = line.get(1..20)?;
+    let naive = chrono::NaiveDateTime::parse_from_str(ts, "%Y-%m-%d %H:%M:%S").ok()?;
+    Some(Local.from_local_datetime(&naive).earliest()?.timestamp())
+}
+
+/// Timestamps of the first and last line of a segment
+fn segment_bounds(path: &Path) -> Option<(i64, i64)> {
+    let file = File::open(path).ok()?;
+    BufReader::new(file)
+        .lines()
+        .map_while(Result::ok)
+        .filter_map(|line| line_timestamp(&line))
+        .fold(None, |bounds, ts| match bounds {
+            None => Some((ts, ts)),
+            Some((first, _)) => Some((first, ts)),
+        })
+}
+
+/// Appends to the current segment and rotates it once it is full. The
+/// current segment is only ever appended to, rotation is a rename.
+struct SegmentWriter {
+    file: File,
+    size: u64,
+    first: Option<i64>,
+    last: i64,
+    segments: Vec<Segment>,
+}
+
+impl SegmentWriter {
+    fn open() -> Result<Self> {
+        let file = open_log()?;
+        let size = file.metadata()?.len();
+        // a reopened segment keeps its bounds, the index needs both once it
+        // is rotated
+        let bounds = segment_bounds(Path::new(defs::SULOG_PATH));
+
+        Ok(Self {
+            file,
+            size,
+            first: bounds.map(|(first, _)| first),
+            last: bounds.map_or(0, |(_, last)| last),
+            segments: load_index(),
+        })
+    }
+
+    fn append(&mut self, lines: &str, first: i64, last: i64) -> Result<()> {
+        if self.size > 0 && self.size + lines.len() as u64 > SULOG_SEGMENT_SIZE {
+            self.rotate()?;
+        }
+
+        self.file.write_all(lines.as_bytes())?;
+        self.size += lines.len() as u64;
+        self.first.get_or_insert(first);
+        self.last = last;
+        Ok(())
+    }
+
+    fn rotate(&mut self) -> Result<()> {
+        let seq = self
+            .segments
+            .iter()
+            .filter_map(|seg| seg.file.split('.').nth(1)?.parse::<u64>().ok())
+            .max()
+            .unwrap_or(0)
+            + 1;
+        let mut name = format!("sulog.{seq}.log");
+
+        fs::rename(defs::SULOG_PATH, segment_path(&name))?;
+        self.file = open_log()?;
+
+        if Path::new(defs::SULOG_COMPRESS_FLAG).exists() {
+            match compress_segment(&name) {
+                Ok(zipped) => name = zipped,
+                Err(e) => warn!("sulogd: compress {name} failed: {e}"),
+            }
+        }
+
+        self.segments.insert(
+            0,
+            Segment {
+                first: self.first.unwrap_or(self.last),
+                last: self.last,
+                file: name,
+            },
+        );
+        for old in self
+            .segments
+            .drain((SULOG_SEGMENTS - 1).min(self.segments.len())..)
+        {
+            let _ = fs::remove_file(segment_path(&old.file));
+        }
+        save_index(&self.segments)?;
+
+        self.size = 0;
+        self.first = None;
+        Ok(())
+    }
+}
+
+fn read_segment(file: &str) -> Result<String> {
+    let path = segment_path(file);
+    if !file.ends_with(".zip") {
+        return Ok(fs::read_to_string(path)?);
+    }
+
+    let mut archive = zip::ZipArchive::new(File::open(path)?)?;
+    let mut content = String::new();
+    archive.by_index(0)?.read_to_string(&mut content)?;
+    Ok(content)
+}
+
+/// Print the persisted sulog, oldest first, skipping everything before
+/// `since` (unix seconds). Whole segments are skipped using the index.
+pub fn dump(since: Option<i64>) -> Result<()> {
+    let since = since.unwrap_or(i64::MIN);
+    let mut stdout = std::io::stdout().lock();
+
+    let mut files: Vec<String> = load_index()
+        .into_iter()
+        .rev()
+        .filter(|seg| seg.last >= since)
+        .map(|seg| seg.file)
+        .collect();
+    files.push("sulog.log".to_string());
+
+    for file in files {
+        let content = match read_segment(&file) {
+            Ok(content) => content,
+            Err(e) => {
+                warn!("read {file} failed: {e}");
+                continue;
+            }
+        };
+        for line in content.lines() {
+            if line_timestamp(line).is_none_or(|ts| ts >= since) {
+                writeln!(stdout, "{line}")?;
+            }
+        }
+    }
+
+    Ok(())
+}
+
+/// Drain the kernel sulog stream into the log file. Blocks until the sulog
+/// fd goes away.
+pub fn run_daemon() -> Result<()> {
+    let fd = ksucalls::get_sulog_fd().context("Failed to get sulog fd")?;
+    // SAFETY: the kernel just handed us this fd and nobody else owns it.
+    let mut stream = unsafe { File::from_raw_fd(fd) };
+    let mut log = SegmentWriter::open()?;
+    let mut buf = vec![0u8; ENTRY_SIZE * READ_BATCH];
+
+    info!("sulogd: started");
+
+    loop {
+        let n = match stream.read(&mut buf) {
+            Ok(0) => break,
+            Ok(n) => n,
+            Err(e) if e.kind() == ErrorKind::Interrupted => continue,
+            Err(e) => return Err(e).context("Failed to read sulog fd"),
+        };
+
+        let mut lines = String::new();
+        let mut first = None;
+        let mut last = 0;
+        for chunk in buf[..n].chunks_exact(ENTRY_SIZE) {
+            // SAFETY: SulogEntry is plain old data and chunk is ENTRY_SIZE long.
+            let entry = unsafe { std::ptr::read_unaligned(chunk.as_ptr().cast::<SulogEntry>()) };
+            if let Some(line) = format_entry(&entry) {
+                lines.push_str(&line);
+                last = (entry.ts_ns / 1_000_000_000) as i64;
+                first.get_or_insert(last);
+            }
+        }
+
+        if let Some(first) = first
+            && let Err(e) = log.append(&lines, first, last)
+        {
+            warn!("sulogd: write failed: {e}");
+            log = SegmentWriter::open()?;
+        }
+    }
+
+    Ok(())
+}
+
+/// Spawn `ksud sulogd` in the background, detached from the caller.
+pub fn start_daemon() -> Result<()> {
+    let exe = if Path::new(defs::DAEMON_PATH).exists() {
+        defs::DAEMON_PATH.into()
+    } else {
+        std::env::current_exe()?
+    };
+
+    unsafe {
+        std::process::Command::new(exe)
+            .process_group(0)
+            .pre_exec(|| {
+                utils::switch_cgroups();
+                Ok(())
+            })
+            .arg("sulogd")
+            .spawn()
+            .context("Failed to spawn sulogd")?;
+    }
+
+    Ok(())
+}
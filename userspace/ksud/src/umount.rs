@@ -9,8 +9,8 @@ use std::path::Path;
 const UMOUNT_CONFIG_MAGIC: u32 = 0x4B53_554D; // KSUM
 
 pub fn save_umount_config() -> Result<()> {
-    let list_output =
-        ksucalls::umount_list_list().context("Failed to get umount list from kernel")?;
+    let entries =
+        ksucalls::umount_list_entries().context("Failed to get umount list from kernel")?;
 
     let config_path = Path::new(defs::UMOUNT_CONFIG_PATH);
 
@@ -25,21 +25,14 @@ pub fn save_umount_config() -> Result<()> {
     file.write_all(&UMOUNT_CONFIG_MAGIC.to_le_bytes())
         .context("Failed to write magic number")?;
 
-    // Parse list output and write entries
-    let lines: Vec<&str> = list_output.lines().collect();
-    // Skip header lines (first 2 lines)
-    for line in lines.iter().skip(2) {
-        let parts: Vec<&str> = line.split_whitespace().collect();
-        if parts.len() >= 2 {
-            let path = parts[0];
-            let flags = parts[1].parse::<u32>().unwrap_or(0);
-
-            // Write path length (u32), path bytes, flags (u32)
-            let path_bytes = path.as_bytes();
-            file.write_all(&(path_bytes.len() as u32).to_le_bytes())?;
-            file.write_all(path_bytes)?;
-            file.write_all(&flags.to_le_bytes())?;
-        }
+    // The kernel hands out the list newest first, store it oldest first so
+    // loading it back recreates the same order
+    for (path, flags) in entries.iter().rev() {
+        // Write path length (u32), path bytes, flags (u32)
+        let path_bytes = path.as_bytes();
+        file.write_all(&(path_bytes.len() as u32).to_le_bytes())?;
+        file.write_all(path_bytes)?;
+        file.write_all(&flags.to_le_bytes())?;
     }
 
     info!("Saved umount config to {}", defs::UMOUNT_CONFIG_PATH);
@@ -69,11 +62,8 @@ pub fn load_umount_config() -> Result<()> {
         return Ok(());
     }
 
-    // Wipe existing list first
-    ksucalls::umount_list_wipe().context("Failed to wipe existing umount list")?;
-
     // Read entries
-    let mut count = 0;
+    let mut entries = Vec::new();
     loop {
         // Read path length
         let mut len_buf = [0u8; 4];
@@ -98,14 +88,17 @@ pub fn load_umount_config() -> Result<()> {
             .context("Failed to read flags")?;
         let flags = u32::from_le_bytes(flags_buf);
 
-        // Add to kernel list
-        ksucalls::umount_list_add(&path, flags)
-            .with_context(|| format!("Failed to add umount path: {path}"))?;
-
-        count += 1;
+        entries.push((path, flags));
     }
 
-    info!("Loaded {count} umount entries from config");
+    // Wipe existing list first, then add everything in bulk
+    ksucalls::umount_list_wipe().context("Failed to wipe existing umount list")?;
+    let added = ksucalls::umount_list_add_bulk(&entries).context("Failed to add umount entries")?;
+
+    info!(
+        "Loaded {added} umount entries from config ({} in file)",
+        entries.len()
+    );
     Ok(())
 }
 